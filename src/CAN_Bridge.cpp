@@ -0,0 +1,230 @@
+#include "CAN_Handling.h"
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#define CAN_BRIDGE_TASK_STACK       4096
+#define CAN_BRIDGE_TASK_PRIORITY    2       // Publishing goes through the MQTT device task, no need to preempt the application
+#define CAN_BRIDGE_MAX_ENTRIES      32
+#define CAN_BRIDGE_STOP_POLL        pdMS_TO_TICKS(20)       // Bounds stop latency with long publish periods
+
+#define CAN_BRIDGE_KEY(id, extd)    ((id) | ((uint32_t)(extd) << 31))
+
+
+/*  ***********************************************
+     ---   ---   ---   ---   ---   ---   ---   ---
+    CAN to MQTT bridge
+     ---   ---   ---   ---   ---   ---   ---   ---
+    ***********************************************   */
+typedef struct {
+    uint32_t key;
+    CanBridgeEntry entry;
+    // Aggregation state, written by the CAN receiver task under canBridgeMux
+    bool pending;
+    float value;
+    uint32_t frames;
+    int64_t firstPending_us;        // Reception time of the oldest frame not yet published
+} CanBridgeSlot;
+
+static std::vector<CanBridgeSlot> canBridgeSlots;       // Sorted by key, only changed while the bridge is stopped
+static portMUX_TYPE canBridgeMux = portMUX_INITIALIZER_UNLOCKED;
+
+static CanBridgeStats canBridgeStats;
+static uint64_t canBridgeLatencySum_ms = 0;
+static portMUX_TYPE canBridgeStatsMux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t canBridgePeriod_ms = 1000;
+static std::atomic<bool> canBridgeRunning(false);
+static TaskHandle_t canBridgeTaskHandle = NULL;
+
+static float canBridgeExtract(const CanBridgeEntry& entry, const CanMessage& msg)
+{
+    uint64_t bits = 0;
+    for (int b = msg.data_length_code - 1; b >= 0; b--)
+        bits = (bits << 8) | msg.data[b];
+
+    uint32_t raw = (uint32_t)(bits >> entry.startBit) & (0xFFFFFFFFu >> (32 - entry.bitLength));
+    if (entry.isSigned && (raw & (1u << (entry.bitLength - 1))))
+        return (float)(int32_t)(raw | ~(0xFFFFFFFFu >> (32 - entry.bitLength))) * entry.scale + entry.offset;
+    return raw * entry.scale + entry.offset;
+}
+
+// Runs in the CAN receiver task, only aggregates
+static void canBridgeListener(const CanMessage& msg)
+{
+    uint32_t key = CAN_BRIDGE_KEY(msg.identifier, IS_CAN_EXTD(msg));
+    auto it = std::lower_bound(canBridgeSlots.begin(), canBridgeSlots.end(), key,
+                               [](const CanBridgeSlot& slot, uint32_t k) { return slot.key < k; });
+    if (it == canBridgeSlots.end() || it->key != key || msg.rtr)
+        return;
+
+    int64_t now_us = esp_timer_get_time();
+    bool coalesced = false;
+
+    // Several entries may decode different signals from the same ID
+    portENTER_CRITICAL(&canBridgeMux);
+    for (; it != canBridgeSlots.end() && it->key == key; ++it)
+    {
+        CanBridgeSlot& slot = *it;
+        if (slot.entry.mode == CAN_BRIDGE_VALUE)
+        {
+            if (slot.entry.startBit + slot.entry.bitLength > msg.data_length_code * 8)
+                continue;
+            coalesced |= slot.pending;
+            slot.value = canBridgeExtract(slot.entry, msg);
+        }
+        slot.frames++;
+        if (!slot.pending)
+        {
+            slot.pending = true;
+            slot.firstPending_us = now_us;
+        }
+    }
+    portEXIT_CRITICAL(&canBridgeMux);
+
+    portENTER_CRITICAL(&canBridgeStatsMux);
+    canBridgeStats.framesMatched++;
+    if (coalesced)
+        canBridgeStats.framesCoalesced++;
+    portEXIT_CRITICAL(&canBridgeStatsMux);
+}
+
+static void canBridgePublish(int64_t now_us)
+{
+    for (CanBridgeSlot& slot : canBridgeSlots)
+    {
+        portENTER_CRITICAL(&canBridgeMux);
+        bool pending = slot.pending;
+        float value = slot.value;
+        uint32_t frames = slot.frames;
+        int64_t firstPending_us = slot.firstPending_us;
+        slot.pending = false;
+        slot.frames = 0;
+        portEXIT_CRITICAL(&canBridgeMux);
+
+        if (slot.entry.mode == CAN_BRIDGE_COUNT)
+            value = frames * 1000.0f / canBridgePeriod_ms;      // Frames/s, published every window even when 0
+        else if (!pending)
+            continue;
+
+        bool published = updateDisplay_Sensor(slot.entry.entity, value);
+        uint32_t latency_ms = pending ? (now_us - firstPending_us) / 1000 : 0;
+
+        portENTER_CRITICAL(&canBridgeStatsMux);
+        if (!published)
+            canBridgeStats.publishFailures++;
+        else if (pending)
+        {
+            canBridgeStats.updatesPublished++;
+            canBridgeLatencySum_ms += latency_ms;
+            if (latency_ms > canBridgeStats.maxLatency_ms)
+                canBridgeStats.maxLatency_ms = latency_ms;
+        }
+        portEXIT_CRITICAL(&canBridgeStatsMux);
+    }
+}
+
+static void canBridgeTask(void* arg)
+{
+    TickType_t nextPublish = xTaskGetTickCount() + pdMS_TO_TICKS(canBridgePeriod_ms);
+
+    while (canBridgeRunning.load(std::memory_order_acquire))
+    {
+        int32_t wait = (int32_t)(nextPublish - xTaskGetTickCount());
+        if (wait > 0)
+        {
+            vTaskDelay(wait < CAN_BRIDGE_STOP_POLL ? wait : CAN_BRIDGE_STOP_POLL);
+            continue;
+        }
+
+        nextPublish += pdMS_TO_TICKS(canBridgePeriod_ms);
+        canBridgePublish(esp_timer_get_time());
+    }
+
+    canBridgeTaskHandle = NULL;
+    vTaskDelete(NULL);
+}
+
+bool EQSP32::addCANBridgeEntry(const CanBridgeEntry& entry)
+{
+    if (canBridgeRunning.load(std::memory_order_acquire) || canBridgeSlots.size() >= CAN_BRIDGE_MAX_ENTRIES || entry.entity.empty())
+        return false;
+    if (entry.mode == CAN_BRIDGE_VALUE && (entry.bitLength == 0 || entry.bitLength > 32 || entry.startBit + entry.bitLength > 64))
+        return false;
+
+    CanBridgeSlot slot = {};
+    slot.key = CAN_BRIDGE_KEY(entry.canID, entry.extendedFrame);
+    slot.entry = entry;
+
+    auto it = std::upper_bound(canBridgeSlots.begin(), canBridgeSlots.end(), slot.key,
+                               [](uint32_t k, const CanBridgeSlot& s) { return k < s.key; });
+    canBridgeSlots.insert(it, slot);
+    return true;
+}
+
+void EQSP32::clearCANBridgeEntries()
+{
+    if (!canBridgeRunning.load(std::memory_order_acquire))
+        canBridgeSlots.clear();
+}
+
+bool EQSP32::startCANBridge(uint32_t publishPeriod_ms)
+{
+    if (publishPeriod_ms == 0 || canBridgeSlots.empty())
+        return false;
+    if (canBridgeRunning.load(std::memory_order_acquire))
+        stopCANBridge();
+
+    if (!startCANReceiver())
+        return false;
+
+    for (CanBridgeSlot& slot : canBridgeSlots)
+    {
+        slot.pending = false;
+        slot.frames = 0;
+    }
+    portENTER_CRITICAL(&canBridgeStatsMux);
+    canBridgeStats = CanBridgeStats();
+    canBridgeLatencySum_ms = 0;
+    portEXIT_CRITICAL(&canBridgeStatsMux);
+
+    canBridgePeriod_ms = publishPeriod_ms;
+    canBridgeRunning.store(true, std::memory_order_release);
+
+    if (xTaskCreatePinnedToCore(canBridgeTask, "EQSP32_CanBrdg", CAN_BRIDGE_TASK_STACK, NULL,
+                                CAN_BRIDGE_TASK_PRIORITY, &canBridgeTaskHandle, tskNO_AFFINITY) != pdPASS)
+    {
+        canBridgeRunning.store(false, std::memory_order_release);
+        return false;
+    }
+
+    if (!canAddListener(canBridgeListener))
+    {
+        stopCANBridge();
+        return false;
+    }
+    return true;
+}
+
+void EQSP32::stopCANBridge()
+{
+    canRemoveListener(canBridgeListener);       // Waits for a running call, the table may then be changed
+
+    if (!canBridgeRunning.exchange(false))
+        return;
+
+    while (canBridgeTaskHandle != NULL)
+        vTaskDelay(pdMS_TO_TICKS(1));
+}
+
+CanBridgeStats EQSP32::getCANBridgeStats()
+{
+    portENTER_CRITICAL(&canBridgeStatsMux);
+    CanBridgeStats stats = canBridgeStats;
+    if (stats.updatesPublished > 0)
+        stats.avgLatency_ms = canBridgeLatencySum_ms / stats.updatesPublished;
+    portEXIT_CRITICAL(&canBridgeStatsMux);
+
+    return stats;
+}
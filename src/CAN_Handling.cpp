@@ -0,0 +1,825 @@
+#include "CAN_Handling.h"
+#include "Memory_Handling.h"
+
+#include <atomic>
+#include <soc/soc.h>
+
+
+/*  ***********************************************
+     ---   ---   ---   ---   ---   ---   ---   ---
+    CAN acceptance filter table
+     ---   ---   ---   ---   ---   ---   ---   ---
+    ***********************************************   */
+#define CAN_FILTER_KEY(id, extd)    ((((id) & TWAI_EXTD_ID_MASK) | ((extd) ? 0x80000000 : 0)) + 1)     // 0 marks an empty slot
+
+typedef struct {
+    uint32_t firstID;
+    uint32_t lastID;
+    bool extd;
+} CanFilterRange;
+
+static uint32_t canFilterIDs[CAN_FILTER_ID_SLOTS];
+static CanFilterRange canFilterRanges[CAN_FILTER_RANGE_SLOTS];
+static int canFilterIDCount = 0;
+static int canFilterRangeCount = 0;
+static portMUX_TYPE canFilterMux = portMUX_INITIALIZER_UNLOCKED;
+
+static inline uint32_t canFilterHash(uint32_t key)
+{
+    return (key * 2654435761u) & (CAN_FILTER_ID_SLOTS - 1);
+}
+
+bool canFilterAccepts(uint32_t canID, bool extendedFrame)
+{
+    bool accepted = false;
+    uint32_t key = CAN_FILTER_KEY(canID, extendedFrame);
+
+    portENTER_CRITICAL(&canFilterMux);
+    if (canFilterIDCount == 0 && canFilterRangeCount == 0)
+        accepted = true;
+
+    for (uint32_t i = canFilterHash(key), n = 0; !accepted && n < CAN_FILTER_ID_SLOTS; i = (i + 1) & (CAN_FILTER_ID_SLOTS - 1), n++)
+    {
+        if (canFilterIDs[i] == 0)
+            break;
+        if (canFilterIDs[i] == key)
+            accepted = true;
+    }
+
+    for (int i = 0; !accepted && i < canFilterRangeCount; i++)
+    {
+        const CanFilterRange& range = canFilterRanges[i];
+        if (range.extd == extendedFrame && canID >= range.firstID && canID <= range.lastID)
+            accepted = true;
+    }
+    portEXIT_CRITICAL(&canFilterMux);
+
+    return accepted;
+}
+
+bool EQSP32::addCANFilter(uint32_t canID, bool extendedFrame)
+{
+    uint32_t key = CAN_FILTER_KEY(canID, extendedFrame);
+    bool added = false;
+
+    portENTER_CRITICAL(&canFilterMux);
+    // Keep the table at most 3/4 full so that probe sequences stay short
+    if (canFilterIDCount < CAN_FILTER_ID_SLOTS * 3 / 4)
+    {
+        uint32_t i = canFilterHash(key);
+        while (canFilterIDs[i] != 0 && canFilterIDs[i] != key)
+            i = (i + 1) & (CAN_FILTER_ID_SLOTS - 1);
+        if (canFilterIDs[i] == 0)
+        {
+            canFilterIDs[i] = key;
+            canFilterIDCount++;
+        }
+        added = true;
+    }
+    portEXIT_CRITICAL(&canFilterMux);
+
+    return added;
+}
+
+bool EQSP32::addCANFilterRange(uint32_t firstID, uint32_t lastID, bool extendedFrame)
+{
+    uint32_t idMask = extendedFrame ? TWAI_EXTD_ID_MASK : TWAI_STD_ID_MASK;
+    if (firstID > lastID || lastID > idMask)
+        return false;
+
+    bool added = false;
+
+    portENTER_CRITICAL(&canFilterMux);
+    if (canFilterRangeCount < CAN_FILTER_RANGE_SLOTS)
+    {
+        canFilterRanges[canFilterRangeCount++] = {firstID, lastID, extendedFrame};
+        added = true;
+    }
+    portEXIT_CRITICAL(&canFilterMux);
+
+    return added;
+}
+
+void EQSP32::clearCANFilters()
+{
+    portENTER_CRITICAL(&canFilterMux);
+    memset(canFilterIDs, 0, sizeof(canFilterIDs));
+    canFilterIDCount = 0;
+    canFilterRangeCount = 0;
+    portEXIT_CRITICAL(&canFilterMux);
+}
+
+
+/*  ***********************************************
+     ---   ---   ---   ---   ---   ---   ---   ---
+    CAN receiver task and ring buffer
+     ---   ---   ---   ---   ---   ---   ---   ---
+    ***********************************************   */
+// Single producer (receiver task), single consumer (receiveCANFrames)
+static std::atomic<CanMessage*> canRxRing(nullptr);
+static uint32_t canRxRingMask = 0;
+static std::atomic<uint32_t> canRxReaders(0);       // receiveCANFrames calls in progress, the ring is not freed under them
+static std::atomic<uint32_t> canRxHead(0);          // Written by the receiver task
+static std::atomic<uint32_t> canRxTail(0);          // Written by the consumer
+static std::atomic<uint32_t> canRxDropped(0);       // Frames lost because the ring was full
+static std::atomic<bool> canRxRunning(false);
+static TaskHandle_t canRxTaskHandle = NULL;
+
+static std::atomic<CanFrameListener> canListeners[CAN_MAX_LISTENERS];
+static std::atomic<uint32_t> canListenerPass(0);        // Odd while the receiver task is calling listeners
+
+bool canAddListener(CanFrameListener listener)
+{
+    for (int i = 0; i < CAN_MAX_LISTENERS; i++)
+    {
+        CanFrameListener expected = nullptr;
+        if (canListeners[i].load() == listener || canListeners[i].compare_exchange_strong(expected, listener))
+            return true;
+    }
+    return false;
+}
+
+void canRemoveListener(CanFrameListener listener)
+{
+    for (int i = 0; i < CAN_MAX_LISTENERS; i++)
+    {
+        CanFrameListener expected = listener;
+        canListeners[i].compare_exchange_strong(expected, nullptr);
+    }
+
+    // Wait for a call that may have loaded the listener before it was removed
+    if (xTaskGetCurrentTaskHandle() == canRxTaskHandle)
+        return;
+    uint32_t pass = canListenerPass.load();
+    while ((pass & 1) && canListenerPass.load() == pass)
+        vTaskDelay(1);
+}
+
+static void canRxTask(void* arg)
+{
+    CanMessage msg;
+
+    while (canRxRunning.load(std::memory_order_acquire))
+    {
+        esp_err_t err = twai_receive(&msg, pdMS_TO_TICKS(CAN_RX_TIMEOUT_MS));
+        canStatsUpdate(esp_timer_get_time());
+        if (err == ESP_ERR_TIMEOUT)
+            continue;
+        if (err != ESP_OK)
+        {
+            // Driver not installed or stopped (e.g. during configCAN), retry later
+            vTaskDelay(pdMS_TO_TICKS(CAN_RX_TIMEOUT_MS));
+            continue;
+        }
+
+        canStatsOnFrame(msg, false);
+
+        canListenerPass.fetch_add(1);
+        for (int i = 0; i < CAN_MAX_LISTENERS; i++)
+        {
+            CanFrameListener listener = canListeners[i].load();
+            if (listener != nullptr)
+                listener(msg);
+        }
+        canListenerPass.fetch_add(1);
+
+        if (!canFilterAccepts(msg.identifier, IS_CAN_EXTD(msg)))
+            continue;
+
+        uint32_t head = canRxHead.load(std::memory_order_relaxed);
+        if (head - canRxTail.load(std::memory_order_acquire) > canRxRingMask)
+        {
+            canRxDropped.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        canRxRing.load(std::memory_order_relaxed)[head & canRxRingMask] = msg;
+        canRxHead.store(head + 1, std::memory_order_release);
+    }
+
+    canRxTaskHandle = NULL;
+    vTaskDelete(NULL);
+}
+
+bool EQSP32::startCANReceiver(size_t ringSize)
+{
+    if (canRxRunning.load(std::memory_order_acquire))
+        return true;
+
+    size_t size = 16;
+    while (size < ringSize)
+        size <<= 1;
+
+    if (canRxRing.load() == nullptr || canRxRingMask + 1 != size)
+    {
+        // Unpublish the old ring and wait for consumers still copying from it before freeing it
+        CanMessage* oldRing = canRxRing.exchange(nullptr);
+        while (canRxReaders.load() != 0)
+            vTaskDelay(1);
+        memoryFree(oldRing);
+
+        CanMessage* ring = (CanMessage*)memoryAlloc(MEMORY_CAN, size * sizeof(CanMessage));
+        if (ring == nullptr)
+        {
+            canRxRingMask = 0;
+            return false;
+        }
+        canRxRingMask = size - 1;
+        canRxRing.store(ring);
+    }
+
+    canRxHead.store(0, std::memory_order_relaxed);
+    canRxTail.store(0, std::memory_order_relaxed);
+    canRxRunning.store(true, std::memory_order_release);
+
+    if (xTaskCreatePinnedToCore(canRxTask, "EQSP32_CanRx", CAN_RX_TASK_STACK, NULL,
+                                CAN_RX_TASK_PRIORITY, &canRxTaskHandle, tskNO_AFFINITY) != pdPASS)
+    {
+        canRxRunning.store(false, std::memory_order_release);
+        return false;
+    }
+    return true;
+}
+
+void EQSP32::stopCANReceiver()
+{
+    if (!canRxRunning.exchange(false))
+        return;
+
+    // Wait for the receiver task to leave its driver poll
+    while (canRxTaskHandle != NULL)
+        vTaskDelay(pdMS_TO_TICKS(1));
+
+    canRxTail.store(canRxHead.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+size_t EQSP32::receiveCANFrames(CanMessage* buf, size_t max)
+{
+    if (buf == nullptr)
+        return 0;
+
+    canRxReaders.fetch_add(1);
+    CanMessage* ring = canRxRing.load();
+    if (ring == nullptr)
+    {
+        canRxReaders.fetch_sub(1);
+        return 0;
+    }
+
+    uint32_t tail = canRxTail.load(std::memory_order_relaxed);
+    uint32_t pending = canRxHead.load(std::memory_order_acquire) - tail;
+    size_t count = pending < max ? pending : max;
+
+    for (size_t i = 0; i < count; i++)
+        buf[i] = ring[(tail + i) & canRxRingMask];
+
+    canRxTail.store(tail + count, std::memory_order_release);
+    canRxReaders.fetch_sub(1);
+    return count;
+}
+
+
+/*  ***********************************************
+     ---   ---   ---   ---   ---   ---   ---   ---
+    CAN transmit scheduler
+     ---   ---   ---   ---   ---   ---   ---   ---
+    ***********************************************   */
+typedef struct {
+    CanMessage msg;
+    int64_t queuedAt_us;
+    uint8_t priority;
+    uint8_t retries;
+} CanTxItem;
+
+typedef struct {
+    CanMessage msg;
+    int64_t period_us;
+    int64_t nextDue_us;
+    uint8_t priority;
+    bool active;
+} CanCyclicFrame;
+
+static QueueHandle_t canTxQueues[CAN_TX_PRIORITIES] = {NULL};
+static size_t canTxQueueSize = 0;
+static CanCyclicFrame canCyclicFrames[CAN_TX_CYCLIC_SLOTS];
+static portMUX_TYPE canCyclicMux = portMUX_INITIALIZER_UNLOCKED;
+
+static CanTxStats canTxStats;
+static uint64_t canTxLatencySum_us = 0;
+static portMUX_TYPE canTxStatsMux = portMUX_INITIALIZER_UNLOCKED;
+
+static std::atomic<bool> canTxRunning(false);
+static TaskHandle_t canTxTaskHandle = NULL;
+
+static bool canTxEnqueue(const CanTxItem& item)
+{
+    bool queued = xQueueSend(canTxQueues[item.priority], &item, 0) == pdTRUE;
+
+    portENTER_CRITICAL(&canTxStatsMux);
+    if (queued)
+        canTxStats.framesQueued++;
+    else
+        canTxStats.framesDropped++;
+    portEXIT_CRITICAL(&canTxStatsMux);
+
+    return queued;
+}
+
+static void canTxScheduleCyclic(int64_t now_us)
+{
+    for (int i = 0; i < CAN_TX_CYCLIC_SLOTS; i++)
+    {
+        CanTxItem item;
+        bool due = false;
+
+        portENTER_CRITICAL(&canCyclicMux);
+        CanCyclicFrame& frame = canCyclicFrames[i];
+        if (frame.active && now_us >= frame.nextDue_us)
+        {
+            item.msg = frame.msg;
+            item.priority = frame.priority;
+            item.retries = 0;
+            item.queuedAt_us = now_us;
+            frame.nextDue_us += frame.period_us;
+            if (frame.nextDue_us <= now_us)             // Fell behind (e.g. bus-off), do not send a burst to catch up
+                frame.nextDue_us = now_us + frame.period_us;
+            due = true;
+        }
+        portEXIT_CRITICAL(&canCyclicMux);
+
+        if (due)
+            canTxEnqueue(item);
+    }
+}
+
+static bool canTxDequeue(CanTxItem& item)
+{
+    for (int p = 0; p < CAN_TX_PRIORITIES; p++)
+        if (xQueueReceive(canTxQueues[p], &item, 0) == pdTRUE)
+            return true;
+    return false;
+}
+
+// Puts a frame that was not sent back in front of its queue, or drops it once it used up its retries
+static void canTxRequeue(CanTxItem item)
+{
+    bool requeued = ++item.retries <= CAN_TX_MAX_RETRIES && xQueueSendToFront(canTxQueues[item.priority], &item, 0) == pdTRUE;
+
+    portENTER_CRITICAL(&canTxStatsMux);
+    if (requeued)
+        canTxStats.framesRequeued++;
+    else
+        canTxStats.framesAbandoned++;
+    portEXIT_CRITICAL(&canTxStatsMux);
+}
+
+static void canTxTask(void* arg)
+{
+    // One scheduler frame is handed to the driver at a time, and only while the driver queue is empty,
+    // so the first transmit alert after the hand-over belongs to that frame even if transmitCANFrame() is used
+    CanTxItem inflight;
+    int64_t inflightAt_us = 0;
+    bool hasInflight = false;
+    uint32_t alerts = 0;
+    bool recovering = false;
+
+    while (canTxRunning.load(std::memory_order_acquire))
+    {
+        if (hasInflight)
+        {
+            uint32_t triggered = 0;
+            esp_err_t err = twai_read_alerts(&triggered, pdMS_TO_TICKS(1));
+            if (err == ESP_OK)
+                alerts |= triggered;
+            else if (err != ESP_ERR_TIMEOUT)
+                vTaskDelay(pdMS_TO_TICKS(1));           // Driver not installed
+        }
+        else
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1));
+
+        canTxScheduleCyclic(esp_timer_get_time());
+
+        twai_status_info_t status;
+        if (twai_get_status_info(&status) != ESP_OK)
+        {
+            if (hasInflight)
+                canTxRequeue(inflight);         // Driver uninstalled (e.g. configCAN), the frame is gone
+            hasInflight = false;
+            continue;
+        }
+
+        if (hasInflight)
+        {
+            // The driver has finished with the frame, its alert is raised together with the queue count update
+            bool finished = status.msgs_to_tx == 0 || status.state == TWAI_STATE_BUS_OFF;
+            if (finished)
+            {
+                uint32_t triggered = 0;
+                if (twai_read_alerts(&triggered, 0) == ESP_OK)
+                    alerts |= triggered;
+            }
+
+            if (alerts & TWAI_ALERT_TX_SUCCESS)
+            {
+                uint32_t latency_us = (uint32_t)(inflightAt_us - inflight.queuedAt_us);
+                canStatsOnFrame(inflight.msg, true);
+                portENTER_CRITICAL(&canTxStatsMux);
+                canTxStats.framesSent++;
+                canTxLatencySum_us += latency_us;
+                if (latency_us > canTxStats.maxLatency_us)
+                    canTxStats.maxLatency_us = latency_us;
+                portEXIT_CRITICAL(&canTxStatsMux);
+                hasInflight = false;
+            }
+            else if ((alerts & TWAI_ALERT_TX_FAILED) || finished)
+            {
+                // Failed, lost on bus-off or dropped by a driver re-install: retry it first
+                canTxRequeue(inflight);
+                hasInflight = false;
+            }
+            else if (esp_timer_get_time() - inflightAt_us > CAN_TX_INFLIGHT_TIMEOUT_MS * 1000LL &&
+                     status.state == TWAI_STATE_RUNNING)
+            {
+                // Nobody acknowledges the frame and the controller retransmits it forever (error passive never reaches
+                // bus-off). Stopping the driver is the only way to abort it, the frames of transmitCANFrame() go with it.
+                if (twai_stop() == ESP_OK)
+                    twai_start();
+                canTxRequeue(inflight);
+                hasInflight = false;
+                continue;
+            }
+        }
+
+        if (status.state == TWAI_STATE_BUS_OFF)
+        {
+            if (!recovering && twai_initiate_recovery() == ESP_OK)
+            {
+                recovering = true;
+                portENTER_CRITICAL(&canTxStatsMux);
+                canTxStats.busOffRecoveries++;
+                portEXIT_CRITICAL(&canTxStatsMux);
+            }
+            continue;
+        }
+        if (status.state == TWAI_STATE_RECOVERING)
+            continue;
+        if (status.state == TWAI_STATE_STOPPED)
+        {
+            // The driver stops once a recovery completes, restart only what we recovered
+            if (recovering && twai_start() == ESP_OK)
+                recovering = false;
+            continue;
+        }
+        recovering = false;
+
+        CanTxItem item;
+        if (hasInflight || status.msgs_to_tx != 0 || !canTxDequeue(item))
+            continue;
+
+        // Re-enabled for every frame since configCAN re-installs the driver; also discards alerts of earlier frames
+        uint32_t stale = 0;
+        twai_reconfigure_alerts(TWAI_ALERT_TX_SUCCESS | TWAI_ALERT_TX_FAILED, &stale);
+        alerts = 0;
+        if (twai_transmit(&item.msg, 0) != ESP_OK)
+        {
+            xQueueSendToFront(canTxQueues[item.priority], &item, 0);
+            continue;
+        }
+
+        inflight = item;
+        inflightAt_us = esp_timer_get_time();
+        hasInflight = true;
+    }
+
+    canTxTaskHandle = NULL;
+    vTaskDelete(NULL);
+}
+
+bool EQSP32::startCANTransmitter(size_t queueSize)
+{
+    if (canTxRunning.load(std::memory_order_acquire))
+        return true;
+
+    for (int p = 0; p < CAN_TX_PRIORITIES; p++)
+    {
+        if (canTxQueues[p] != NULL && canTxQueueSize != queueSize)
+        {
+            vQueueDelete(canTxQueues[p]);
+            canTxQueues[p] = NULL;
+        }
+        if (canTxQueues[p] == NULL)
+            canTxQueues[p] = xQueueCreate(queueSize, sizeof(CanTxItem));
+        else
+            xQueueReset(canTxQueues[p]);
+        if (canTxQueues[p] == NULL)
+            return false;
+    }
+    canTxQueueSize = queueSize;
+
+    canTxRunning.store(true, std::memory_order_release);
+    if (xTaskCreatePinnedToCore(canTxTask, "EQSP32_CanTx", CAN_TX_TASK_STACK, NULL,
+                                CAN_TX_TASK_PRIORITY, &canTxTaskHandle, tskNO_AFFINITY) != pdPASS)
+    {
+        canTxRunning.store(false, std::memory_order_release);
+        return false;
+    }
+    return true;
+}
+
+void EQSP32::stopCANTransmitter()
+{
+    if (!canTxRunning.exchange(false))
+        return;
+
+    while (canTxTaskHandle != NULL)
+        vTaskDelay(pdMS_TO_TICKS(1));
+
+    for (int p = 0; p < CAN_TX_PRIORITIES; p++)
+        xQueueReset(canTxQueues[p]);
+}
+
+bool EQSP32::queueCANFrame(const CanMessage& canMessage, CanTxPriority priority)
+{
+    return canQueueFrame(canMessage, priority);
+}
+
+bool canQueueFrame(const CanMessage& canMessage, CanTxPriority priority)
+{
+    if (!canTxRunning.load(std::memory_order_acquire) || priority < CAN_TX_HIGH || priority >= CAN_TX_PRIORITIES)
+        return false;
+
+    CanTxItem item;
+    item.msg = canMessage;
+    item.priority = priority;
+    item.retries = 0;
+    item.queuedAt_us = esp_timer_get_time();
+
+    if (!canTxEnqueue(item))
+        return false;
+
+    xTaskNotifyGive(canTxTaskHandle);
+    return true;
+}
+
+int EQSP32::addCANCyclicFrame(const CanMessage& canMessage, uint32_t period_ms, CanTxPriority priority)
+{
+    if (period_ms == 0 || priority < CAN_TX_HIGH || priority >= CAN_TX_PRIORITIES)
+        return -1;
+
+    int handle = -1;
+
+    portENTER_CRITICAL(&canCyclicMux);
+    for (int i = 0; i < CAN_TX_CYCLIC_SLOTS; i++)
+    {
+        CanCyclicFrame& frame = canCyclicFrames[i];
+        if (frame.active)
+            continue;
+        frame.msg = canMessage;
+        frame.period_us = (int64_t)period_ms * 1000;
+        frame.nextDue_us = esp_timer_get_time();
+        frame.priority = priority;
+        frame.active = true;
+        handle = i;
+        break;
+    }
+    portEXIT_CRITICAL(&canCyclicMux);
+
+    return handle;
+}
+
+bool EQSP32::updateCANCyclicFrame(int handle, const CanMessage& canMessage)
+{
+    if (handle < 0 || handle >= CAN_TX_CYCLIC_SLOTS)
+        return false;
+
+    bool updated = false;
+
+    portENTER_CRITICAL(&canCyclicMux);
+    if (canCyclicFrames[handle].active)
+    {
+        canCyclicFrames[handle].msg = canMessage;
+        updated = true;
+    }
+    portEXIT_CRITICAL(&canCyclicMux);
+
+    return updated;
+}
+
+void EQSP32::removeCANCyclicFrame(int handle)
+{
+    if (handle < 0 || handle >= CAN_TX_CYCLIC_SLOTS)
+        return;
+
+    portENTER_CRITICAL(&canCyclicMux);
+    canCyclicFrames[handle].active = false;
+    portEXIT_CRITICAL(&canCyclicMux);
+}
+
+CanTxStats EQSP32::getCANTxStats()
+{
+    CanTxStats stats;
+
+    portENTER_CRITICAL(&canTxStatsMux);
+    stats = canTxStats;
+    if (stats.framesSent > 0)
+        stats.avgLatency_us = (uint32_t)(canTxLatencySum_us / stats.framesSent);
+    portEXIT_CRITICAL(&canTxStatsMux);
+
+    stats.pending = 0;
+    for (int p = 0; p < CAN_TX_PRIORITIES; p++)
+        if (canTxQueues[p] != NULL)
+            stats.pending += uxQueueMessagesWaiting(canTxQueues[p]);
+
+    return stats;
+}
+
+
+/*  ***********************************************
+     ---   ---   ---   ---   ---   ---   ---   ---
+    CAN bus statistics
+     ---   ---   ---   ---   ---   ---   ---   ---
+    ***********************************************   */
+typedef struct {
+    uint32_t key;               // CAN_FILTER_KEY of the ID, 0 marks a free counter
+    uint32_t count;
+} CanIdCounter;
+
+static portMUX_TYPE canStatsMux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t canStatsRxFrames = 0;
+static uint32_t canStatsTxFrames = 0;
+static uint32_t canStatsErrorPassiveCount = 0;
+static uint32_t canStatsBusOffCount = 0;
+
+// Current window
+static int64_t canStatsWindowStart_us = 0;
+static uint32_t canStatsWindowRx = 0;
+static uint32_t canStatsWindowTx = 0;
+static uint64_t canStatsWindowBits = 0;
+static CanIdCounter canStatsIDs[CAN_STATS_TRACKED_IDS];
+
+// Last completed window
+static uint32_t canStatsRxRate = 0;
+static uint32_t canStatsTxRate = 0;
+static uint64_t canStatsBits = 0;
+static int64_t canStatsWindow_us = 0;
+static CanIdRate canStatsTopIDs[CAN_STATS_TOP_IDS];
+
+// Owned by the receiver task
+static int64_t canStatsLastSample_us = 0;
+static bool canStatsErrorPassive = false;
+static bool canStatsBusOff = false;
+
+static uint32_t canFrameBits(const CanMessage& msg)
+{
+    uint32_t dlc = msg.data_length_code > TWAI_FRAME_MAX_DLC ? TWAI_FRAME_MAX_DLC : msg.data_length_code;
+    uint32_t dataBits = msg.rtr ? 0 : 8 * dlc;
+
+    // SOF, arbitration, control, CRC, ACK, EOF and intermission, without stuff bits
+    return (IS_CAN_EXTD(msg) ? 67 : 47) + dataBits;
+}
+
+void canStatsOnFrame(const CanMessage& msg, bool transmitted)
+{
+    uint32_t key = CAN_FILTER_KEY(msg.identifier, IS_CAN_EXTD(msg));
+
+    portENTER_CRITICAL(&canStatsMux);
+    if (transmitted)
+    {
+        canStatsTxFrames++;
+        canStatsWindowTx++;
+    }
+    else
+    {
+        canStatsRxFrames++;
+        canStatsWindowRx++;
+    }
+    canStatsWindowBits += canFrameBits(msg);
+
+    // Space-saving top-N: count tracked IDs, otherwise take over the least frequent counter
+    int minIdx = 0;
+    int i = 0;
+    for (; i < CAN_STATS_TRACKED_IDS; i++)
+    {
+        if (canStatsIDs[i].key == key || canStatsIDs[i].key == 0)
+            break;
+        if (canStatsIDs[i].count < canStatsIDs[minIdx].count)
+            minIdx = i;
+    }
+    if (i < CAN_STATS_TRACKED_IDS)
+    {
+        canStatsIDs[i].key = key;
+        canStatsIDs[i].count++;
+    }
+    else
+    {
+        canStatsIDs[minIdx].key = key;
+        canStatsIDs[minIdx].count++;
+    }
+    portEXIT_CRITICAL(&canStatsMux);
+}
+
+void canStatsUpdate(int64_t now_us)
+{
+    if (now_us - canStatsLastSample_us >= CAN_STATS_SAMPLE_MS * 1000)
+    {
+        canStatsLastSample_us = now_us;
+
+        twai_status_info_t status;
+        if (twai_get_status_info(&status) == ESP_OK)
+        {
+            bool errorPassive = status.tx_error_counter > 127 || status.rx_error_counter > 127;
+            bool busOff = status.state == TWAI_STATE_BUS_OFF;
+
+            portENTER_CRITICAL(&canStatsMux);
+            if (errorPassive && !canStatsErrorPassive)
+                canStatsErrorPassiveCount++;
+            if (busOff && !canStatsBusOff)
+                canStatsBusOffCount++;
+            portEXIT_CRITICAL(&canStatsMux);
+
+            canStatsErrorPassive = errorPassive;
+            canStatsBusOff = busOff;
+        }
+    }
+
+    if (canStatsWindowStart_us == 0)
+        canStatsWindowStart_us = now_us;
+
+    int64_t window_us = now_us - canStatsWindowStart_us;
+    if (window_us < CAN_STATS_WINDOW_MS * 1000)
+        return;
+
+    portENTER_CRITICAL(&canStatsMux);
+    canStatsRxRate = (uint32_t)((uint64_t)canStatsWindowRx * 1000000 / window_us);
+    canStatsTxRate = (uint32_t)((uint64_t)canStatsWindowTx * 1000000 / window_us);
+    canStatsBits = canStatsWindowBits;
+    canStatsWindow_us = window_us;
+
+    // Partial selection sort of the counters, highest count first
+    for (int t = 0; t < CAN_STATS_TOP_IDS; t++)
+    {
+        int best = t;
+        for (int i = t + 1; i < CAN_STATS_TRACKED_IDS; i++)
+            if (canStatsIDs[i].count > canStatsIDs[best].count)
+                best = i;
+        CanIdCounter top = canStatsIDs[best];
+        canStatsIDs[best] = canStatsIDs[t];
+        canStatsIDs[t] = top;
+
+        canStatsTopIDs[t] = CanIdRate();
+        if (top.key != 0)
+        {
+            canStatsTopIDs[t].identifier = (top.key - 1) & TWAI_EXTD_ID_MASK;
+            canStatsTopIDs[t].extd = ((top.key - 1) & 0x80000000) != 0;
+            canStatsTopIDs[t].frameRate = (uint32_t)((uint64_t)top.count * 1000000 / window_us);
+        }
+    }
+
+    memset(canStatsIDs, 0, sizeof(canStatsIDs));
+    canStatsWindowRx = 0;
+    canStatsWindowTx = 0;
+    canStatsWindowBits = 0;
+    canStatsWindowStart_us = now_us;
+    portEXIT_CRITICAL(&canStatsMux);
+}
+
+CanStats EQSP32::getCANStats(CanBitRates CAN_BITRATE)
+{
+    CanStats stats;
+
+    twai_status_info_t status;
+    if (twai_get_status_info(&status) == ESP_OK)
+    {
+        stats.state = status.state;
+        stats.rxMissed = status.rx_missed_count;
+        stats.rxOverruns = status.rx_overrun_count;
+        stats.txFailed = status.tx_failed_count;
+        stats.arbitrationLost = status.arb_lost_count;
+        stats.busErrors = status.bus_error_count;
+        stats.txErrorCounter = status.tx_error_counter;
+        stats.rxErrorCounter = status.rx_error_counter;
+    }
+    stats.rxDropped = canRxDropped.load(std::memory_order_relaxed);
+
+    portENTER_CRITICAL(&canStatsMux);
+    stats.rxFrames = canStatsRxFrames;
+    stats.txFrames = canStatsTxFrames;
+    stats.rxFrameRate = canStatsRxRate;
+    stats.txFrameRate = canStatsTxRate;
+    stats.errorPassiveCount = canStatsErrorPassiveCount;
+    stats.busOffCount = canStatsBusOffCount;
+    for (int t = 0; t < CAN_STATS_TOP_IDS; t++)
+        stats.topIDs[t] = canStatsTopIDs[t];
+    uint64_t bits = canStatsBits;
+    int64_t window_us = canStatsWindow_us;
+    portEXIT_CRITICAL(&canStatsMux);
+
+    if (window_us > 0 && CAN_BITRATE >= CAN_25K && CAN_BITRATE <= CAN_1000K)
+    {
+        // Same timing configCAN() installs, the TWAI controller is clocked from APB
+        twai_timing_config_t timing = getCanBitRate(CAN_BITRATE);
+        uint32_t bitRate_bps = APB_CLK_FREQ / (timing.brp * (1 + timing.tseg_1 + timing.tseg_2));
+        stats.busLoad = (float)((double)bits * 1000000.0 * 100.0 / ((double)bitRate_bps * window_us));
+    }
+
+    return stats;
+}
@@ -0,0 +1,42 @@
+#ifndef CAN_Handling_h
+#define CAN_Handling_h
+
+#include "EQSP32.h"
+
+#define CAN_RX_TASK_STACK       3072
+#define CAN_RX_TASK_PRIORITY    (configMAX_PRIORITIES - 3)      // Drain the driver queue ahead of application tasks
+#define CAN_RX_TIMEOUT_MS       20                              // Driver poll timeout, also bounds stop latency
+
+#define CAN_TX_TASK_STACK       3072
+#define CAN_TX_TASK_PRIORITY    (configMAX_PRIORITIES - 4)
+#define CAN_TX_CYCLIC_SLOTS     32
+#define CAN_TX_MAX_RETRIES      3       // Re-queues of a frame that failed before it is dropped
+#define CAN_TX_INFLIGHT_TIMEOUT_MS  100 // A frame the driver has not finished by then is aborted and retried
+
+#define CAN_FILTER_ID_SLOTS     128     // Exact ID hash table size (power of two)
+#define CAN_FILTER_RANGE_SLOTS  16      // ID range entries
+
+#define CAN_STATS_WINDOW_MS         1000
+#define CAN_STATS_SAMPLE_MS         10      // Driver status sampling period for state transitions
+#define CAN_STATS_TRACKED_IDS       16      // Top-N counters, more than reported to keep the top entries accurate
+
+#define CAN_MAX_LISTENERS           4       // Protocol layers fed by the receiver task
+
+#define IS_CAN_EXTD(msg)        ((msg).extd != 0)
+
+// Listeners run in the receiver task for every received frame, regardless of the acceptance filter table.
+// They must not block; protocol layers hand the frame over to their own task.
+typedef void (*CanFrameListener)(const CanMessage& msg);
+
+bool canAddListener(CanFrameListener listener);
+void canRemoveListener(CanFrameListener listener);       // The listener is no longer running once this returns
+bool canQueueFrame(const CanMessage& msg, CanTxPriority priority);
+
+// Bit timing of each CanBitRates value, defined by the library core and used by configCAN()
+twai_timing_config_t getCanBitRate(CanBitRates bitrate);
+
+bool canFilterAccepts(uint32_t canID, bool extendedFrame);
+void canStatsOnFrame(const CanMessage& msg, bool transmitted);
+void canStatsUpdate(int64_t now_us);
+
+#endif
@@ -0,0 +1,554 @@
+#include "CAN_Handling.h"
+#include "Sampling_Handling.h"
+#include "Task_Handling.h"
+
+#include <atomic>
+
+#define CANOPEN_TASK_STACK      4096
+#define CANOPEN_TASK_PRIORITY   TASK_PRIORITY_PROTOCOL
+#define CANOPEN_TICK_MS         10      // Event TPDO change detection and heartbeat resolution
+#define CANOPEN_RX_QUEUE_SIZE   32
+
+// Predefined connection set
+#define CANOPEN_COB_NMT         0x000
+#define CANOPEN_COB_SYNC        0x080
+#define CANOPEN_COB_TPDO(n)     (0x180 + 0x100 * ((n) - 1))
+#define CANOPEN_COB_RPDO(n)     (0x200 + 0x100 * ((n) - 1))
+#define CANOPEN_COB_SDO_TX      0x580
+#define CANOPEN_COB_SDO_RX      0x600
+#define CANOPEN_COB_HEARTBEAT   0x700
+
+// NMT commands
+#define CANOPEN_NMT_START       0x01
+#define CANOPEN_NMT_STOP        0x02
+#define CANOPEN_NMT_PRE_OP      0x80
+#define CANOPEN_NMT_RESET_NODE  0x81
+#define CANOPEN_NMT_RESET_COMM  0x82
+
+// SDO abort codes
+#define SDO_ABORT_COMMAND       0x05040001
+#define SDO_ABORT_UNSUPPORTED   0x06010000
+#define SDO_ABORT_READ_ONLY     0x06010002
+#define SDO_ABORT_NO_OBJECT     0x06020000
+#define SDO_ABORT_NO_SUBINDEX   0x06090011
+#define SDO_ABORT_GENERAL       0x08000000
+
+
+/*  ***********************************************
+     ---   ---   ---   ---   ---   ---   ---   ---
+    CANopen object dictionary
+     ---   ---   ---   ---   ---   ---   ---   ---
+    ***********************************************   */
+static EQSP32* coEQ = nullptr;
+static std::atomic<uint16_t> coHeartbeat_ms(0);
+static int32_t coPinValues[16];         // Last value written to each pin through the OD, read back for digital pins
+
+typedef struct {
+    uint16_t index;
+    uint8_t subCount;           // Highest sub-index, 0 for simple variables
+    uint8_t size;               // Size in bytes of each entry
+    bool writable;
+    bool isSigned;
+    bool (*read)(uint8_t sub, int32_t& value);
+    bool (*write)(uint8_t sub, int32_t value);
+} CanOpenObject;
+
+static bool odReadZero(uint8_t sub, int32_t& value)             { value = 0; return true; }
+static bool odReadHeartbeat(uint8_t sub, int32_t& value)        { value = coHeartbeat_ms.load(); return true; }
+static bool odWriteHeartbeat(uint8_t sub, int32_t value)        { coHeartbeat_ms.store((uint16_t)value); return true; }
+static bool odReadUserInt(uint8_t sub, int32_t& value)          { value = userIntSample(sub); return true; }
+static bool odWriteUserInt(uint8_t sub, int32_t value)          { coEQ->writeUserInt(sub, value); return true; }
+static bool odReadUserBool(uint8_t sub, int32_t& value)         { value = userBoolSample(sub); return true; }
+static bool odWriteUserBool(uint8_t sub, int32_t value)         { coEQ->writeUserBool(sub, value != 0); return true; }
+
+// Analog inputs are sampled, digital pins are not read because readPin() would reset the edge state of the sketch's
+// trigger mode reads. They return what was last written through the OD.
+static bool odReadPin(uint8_t sub, int32_t& value)
+{
+    int sample;
+    value = pinSampleAnalog(coEQ, sub, sample) ? sample : coPinValues[sub - 1];
+    return true;
+}
+
+static bool odWritePin(uint8_t sub, int32_t value)
+{
+    if (!coEQ->pinValue(sub, value))
+        return false;
+    coPinValues[sub - 1] = value;
+    return true;
+}
+
+static bool odReadSupply(uint8_t sub, int32_t& value)
+{
+    value = sub == 1 ? coEQ->readInputVoltage() : coEQ->readOutputVoltage();
+    return true;
+}
+
+static const CanOpenObject canOpenOD[] = {
+    // index                subCount    size    writable    signed  read                write
+    {0x1000,                0,          4,      false,      false,  odReadZero,         nullptr},           // Device type
+    {0x1001,                0,          1,      false,      false,  odReadZero,         nullptr},           // Error register
+    {0x1017,                0,          2,      true,       false,  odReadHeartbeat,    odWriteHeartbeat},  // Producer heartbeat time
+    {0x1018,                1,          4,      false,      false,  odReadZero,         nullptr},           // Identity (vendor ID)
+    {CANOPEN_OD_PIN,        16,         4,      true,       true,   odReadPin,          odWritePin},
+    {CANOPEN_OD_USER_INT,   32,         4,      true,       true,   odReadUserInt,      odWriteUserInt},
+    {CANOPEN_OD_USER_BOOL,  32,         1,      true,       false,  odReadUserBool,     odWriteUserBool},
+    {CANOPEN_OD_SUPPLY,     2,          4,      false,      true,   odReadSupply,       nullptr},
+};
+
+static const CanOpenObject* canOpenFindObject(uint16_t index)
+{
+    for (size_t i = 0; i < sizeof(canOpenOD) / sizeof(canOpenOD[0]); i++)
+        if (canOpenOD[i].index == index)
+            return &canOpenOD[i];
+    return nullptr;
+}
+
+// Returns 0 on success, or the SDO abort code
+static uint32_t canOpenRead(uint16_t index, uint8_t sub, int32_t& value, uint8_t& size)
+{
+    const CanOpenObject* obj = canOpenFindObject(index);
+    if (obj == nullptr)
+        return SDO_ABORT_NO_OBJECT;
+
+    if (obj->subCount > 0 && sub == 0)
+    {
+        value = obj->subCount;
+        size = 1;
+        return 0;
+    }
+    if ((obj->subCount == 0 && sub != 0) || sub > obj->subCount)
+        return SDO_ABORT_NO_SUBINDEX;
+
+    size = obj->size;
+    return obj->read(sub, value) ? 0 : SDO_ABORT_GENERAL;
+}
+
+static uint32_t canOpenWrite(uint16_t index, uint8_t sub, int32_t value)
+{
+    const CanOpenObject* obj = canOpenFindObject(index);
+    if (obj == nullptr)
+        return SDO_ABORT_NO_OBJECT;
+    if ((obj->subCount == 0 && sub != 0) || sub > obj->subCount)
+        return SDO_ABORT_NO_SUBINDEX;
+    if (!obj->writable || (obj->subCount > 0 && sub == 0))
+        return SDO_ABORT_READ_ONLY;
+
+    return obj->write(sub, value) ? 0 : SDO_ABORT_GENERAL;
+}
+
+
+/*  ***********************************************
+     ---   ---   ---   ---   ---   ---   ---   ---
+    CANopen PDO mapping
+     ---   ---   ---   ---   ---   ---   ---   ---
+    ***********************************************   */
+typedef struct {
+    CanOpenPdoMap map[CANOPEN_MAX_PDO_MAP];
+    uint8_t count;
+    uint8_t transmissionType;
+    uint16_t eventTimer_ms;
+} CanOpenPdoConfig;
+
+typedef struct {
+    uint8_t syncCounter;
+    uint8_t lastData[TWAI_FRAME_MAX_DLC];
+    uint8_t lastLength;
+    bool sent;
+    int64_t lastSent_us;
+} CanOpenTPdoState;
+
+static CanOpenPdoConfig coTPdos[CANOPEN_MAX_PDO];
+static CanOpenPdoConfig coRPdos[CANOPEN_MAX_PDO];
+static CanOpenTPdoState coTPdoStates[CANOPEN_MAX_PDO];     // Owned by the CANopen task
+static portMUX_TYPE coMux = portMUX_INITIALIZER_UNLOCKED;
+
+static bool canOpenValidMap(const CanOpenPdoMap* map, int count)
+{
+    if (count < 0 || count > CANOPEN_MAX_PDO_MAP || (count > 0 && map == nullptr))
+        return false;
+
+    int bits = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (map[i].bitLength != 8 && map[i].bitLength != 16 && map[i].bitLength != 32)
+            return false;
+        const CanOpenObject* obj = canOpenFindObject(map[i].index);
+        if (obj == nullptr || map[i].subIndex == 0 || map[i].subIndex > obj->subCount)
+            return false;
+        bits += map[i].bitLength;
+    }
+    return bits <= 8 * TWAI_FRAME_MAX_DLC;
+}
+
+static bool canOpenPackPdo(const CanOpenPdoConfig& pdo, uint8_t* data, uint8_t& length)
+{
+    length = 0;
+    for (int i = 0; i < pdo.count; i++)
+    {
+        int32_t value;
+        uint8_t size;
+        if (canOpenRead(pdo.map[i].index, pdo.map[i].subIndex, value, size) != 0)
+            return false;
+        for (int b = 0; b < pdo.map[i].bitLength / 8; b++)
+            data[length++] = (uint8_t)((uint32_t)value >> (8 * b));
+    }
+    return true;
+}
+
+static void canOpenUnpackPdo(const CanOpenPdoConfig& pdo, const CanMessage& msg)
+{
+    uint8_t offset = 0;
+    for (int i = 0; i < pdo.count; i++)
+    {
+        uint8_t bytes = pdo.map[i].bitLength / 8;
+        if (offset + bytes > msg.data_length_code)
+            return;             // Short PDO, ignore the remaining objects
+
+        uint32_t raw = 0;
+        for (int b = 0; b < bytes; b++)
+            raw |= (uint32_t)msg.data[offset + b] << (8 * b);
+        offset += bytes;
+
+        int32_t value = (int32_t)raw;
+        const CanOpenObject* obj = canOpenFindObject(pdo.map[i].index);
+        if (obj->isSigned && bytes < 4 && (raw & (1u << (8 * bytes - 1))))
+            value = (int32_t)(raw | (0xFFFFFFFFu << (8 * bytes)));      // Sign extend
+
+        canOpenWrite(pdo.map[i].index, pdo.map[i].subIndex, value);
+    }
+}
+
+bool EQSP32::configCANopenTPDO(int pdo, const CanOpenPdoMap* map, int count, uint8_t transmissionType, uint16_t eventTimer_ms)
+{
+    if (pdo < 1 || pdo > CANOPEN_MAX_PDO || !canOpenValidMap(map, count))
+        return false;
+    if (transmissionType > 240 && transmissionType != CANOPEN_PDO_EVENT)
+        return false;
+
+    portENTER_CRITICAL(&coMux);
+    CanOpenPdoConfig& cfg = coTPdos[pdo - 1];
+    for (int i = 0; i < count; i++)
+        cfg.map[i] = map[i];
+    cfg.count = count;
+    cfg.transmissionType = transmissionType;
+    cfg.eventTimer_ms = eventTimer_ms;
+    portEXIT_CRITICAL(&coMux);
+
+    return true;
+}
+
+bool EQSP32::configCANopenRPDO(int pdo, const CanOpenPdoMap* map, int count)
+{
+    if (pdo < 1 || pdo > CANOPEN_MAX_PDO || !canOpenValidMap(map, count))
+        return false;
+
+    // Read only objects cannot be RPDO targets
+    for (int i = 0; i < count; i++)
+        if (!canOpenFindObject(map[i].index)->writable)
+            return false;
+
+    portENTER_CRITICAL(&coMux);
+    CanOpenPdoConfig& cfg = coRPdos[pdo - 1];
+    for (int i = 0; i < count; i++)
+        cfg.map[i] = map[i];
+    cfg.count = count;
+    portEXIT_CRITICAL(&coMux);
+
+    return true;
+}
+
+
+/*  ***********************************************
+     ---   ---   ---   ---   ---   ---   ---   ---
+    CANopen slave task
+     ---   ---   ---   ---   ---   ---   ---   ---
+    ***********************************************   */
+static uint8_t coNodeID = 0;
+static std::atomic<CanOpenNmtState> coState(CANOPEN_BOOTUP);
+static std::atomic<bool> coRunning(false);
+static QueueHandle_t coRxQueue = NULL;
+static TaskHandle_t coTaskHandle = NULL;
+
+static void canOpenSend(uint32_t cobID, const uint8_t* data, uint8_t length, CanTxPriority priority)
+{
+    CanMessage msg = {};
+    msg.identifier = cobID;
+    msg.data_length_code = length;
+    memcpy(msg.data, data, length);
+    canQueueFrame(msg, priority);
+}
+
+static void canOpenSendHeartbeat()
+{
+    uint8_t state = coState.load();
+    canOpenSend(CANOPEN_COB_HEARTBEAT + coNodeID, &state, 1, CAN_TX_HIGH);
+}
+
+static void canOpenSdoAbort(uint16_t index, uint8_t sub, uint32_t code)
+{
+    uint8_t data[8] = {0x80, (uint8_t)index, (uint8_t)(index >> 8), sub,
+                       (uint8_t)code, (uint8_t)(code >> 8), (uint8_t)(code >> 16), (uint8_t)(code >> 24)};
+    canOpenSend(CANOPEN_COB_SDO_TX + coNodeID, data, 8, CAN_TX_LOW);
+}
+
+// Expedited transfers only, every object of the dictionary fits in 4 bytes
+static void canOpenProcessSdo(const CanMessage& msg)
+{
+    if (msg.data_length_code < 8)
+        return;
+
+    uint8_t ccs = msg.data[0] >> 5;
+    uint16_t index = msg.data[1] | (msg.data[2] << 8);
+    uint8_t sub = msg.data[3];
+
+    if (ccs == 2)           // Initiate upload
+    {
+        int32_t value;
+        uint8_t size;
+        uint32_t abortCode = canOpenRead(index, sub, value, size);
+        if (abortCode != 0)
+            return canOpenSdoAbort(index, sub, abortCode);
+
+        uint8_t data[8] = {(uint8_t)(0x43 | ((4 - size) << 2)), msg.data[1], msg.data[2], sub,
+                           (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+        canOpenSend(CANOPEN_COB_SDO_TX + coNodeID, data, 8, CAN_TX_LOW);
+    }
+    else if (ccs == 1)      // Initiate download
+    {
+        bool expedited = msg.data[0] & 0x02;
+        bool sizeIndicated = msg.data[0] & 0x01;
+        if (!expedited)
+            return canOpenSdoAbort(index, sub, SDO_ABORT_UNSUPPORTED);
+
+        uint8_t size = sizeIndicated ? 4 - ((msg.data[0] >> 2) & 0x03) : 4;
+        uint32_t raw = 0;
+        for (int b = 0; b < size; b++)
+            raw |= (uint32_t)msg.data[4 + b] << (8 * b);
+
+        uint32_t abortCode = canOpenWrite(index, sub, (int32_t)raw);
+        if (abortCode != 0)
+            return canOpenSdoAbort(index, sub, abortCode);
+
+        uint8_t data[8] = {0x60, msg.data[1], msg.data[2], sub, 0, 0, 0, 0};
+        canOpenSend(CANOPEN_COB_SDO_TX + coNodeID, data, 8, CAN_TX_LOW);
+    }
+    else if (ccs != 4)      // Anything but a client abort
+    {
+        canOpenSdoAbort(index, sub, SDO_ABORT_COMMAND);
+    }
+}
+
+static void canOpenSendTPdo(int n, const CanOpenPdoConfig& cfg, bool onChangeOnly, int64_t now_us)
+{
+    CanOpenTPdoState& state = coTPdoStates[n];
+    uint8_t data[TWAI_FRAME_MAX_DLC];
+    uint8_t length;
+
+    if (!canOpenPackPdo(cfg, data, length))
+        return;
+
+    bool changed = !state.sent || length != state.lastLength || memcmp(data, state.lastData, length) != 0;
+    if (onChangeOnly && !changed)
+        return;
+
+    canOpenSend(CANOPEN_COB_TPDO(n + 1) + coNodeID, data, length, CAN_TX_NORMAL);
+    memcpy(state.lastData, data, length);
+    state.lastLength = length;
+    state.sent = true;
+    state.lastSent_us = now_us;
+}
+
+static void canOpenProcessSync(int64_t now_us)
+{
+    for (int n = 0; n < CANOPEN_MAX_PDO; n++)
+    {
+        portENTER_CRITICAL(&coMux);
+        CanOpenPdoConfig cfg = coTPdos[n];
+        portEXIT_CRITICAL(&coMux);
+
+        if (cfg.count == 0 || cfg.transmissionType == CANOPEN_PDO_EVENT)
+            continue;
+
+        if (cfg.transmissionType == CANOPEN_PDO_SYNC_ACYCLIC)
+        {
+            canOpenSendTPdo(n, cfg, true, now_us);
+        }
+        else if (++coTPdoStates[n].syncCounter >= cfg.transmissionType)
+        {
+            coTPdoStates[n].syncCounter = 0;
+            canOpenSendTPdo(n, cfg, false, now_us);
+        }
+    }
+}
+
+static void canOpenProcessEventPdos(int64_t now_us)
+{
+    for (int n = 0; n < CANOPEN_MAX_PDO; n++)
+    {
+        portENTER_CRITICAL(&coMux);
+        CanOpenPdoConfig cfg = coTPdos[n];
+        portEXIT_CRITICAL(&coMux);
+
+        if (cfg.count == 0 || cfg.transmissionType != CANOPEN_PDO_EVENT)
+            continue;
+
+        bool timerDue = cfg.eventTimer_ms > 0 && now_us - coTPdoStates[n].lastSent_us >= (int64_t)cfg.eventTimer_ms * 1000;
+        canOpenSendTPdo(n, cfg, !timerDue, now_us);
+    }
+}
+
+static void canOpenResetCommunication()
+{
+    memset(coTPdoStates, 0, sizeof(coTPdoStates));
+    coState.store(CANOPEN_BOOTUP);
+    canOpenSendHeartbeat();                 // Boot-up message
+    coState.store(CANOPEN_PRE_OPERATIONAL);
+}
+
+static void canOpenProcessNmt(const CanMessage& msg)
+{
+    if (msg.data_length_code < 2 || (msg.data[1] != 0 && msg.data[1] != coNodeID))
+        return;
+
+    switch (msg.data[0])
+    {
+        case CANOPEN_NMT_START:         coState.store(CANOPEN_OPERATIONAL); break;
+        case CANOPEN_NMT_STOP:          coState.store(CANOPEN_STOPPED); break;
+        case CANOPEN_NMT_PRE_OP:        coState.store(CANOPEN_PRE_OPERATIONAL); break;
+        case CANOPEN_NMT_RESET_NODE:
+        case CANOPEN_NMT_RESET_COMM:    canOpenResetCommunication(); break;
+        default: break;
+    }
+}
+
+static void canOpenProcessFrame(const CanMessage& msg, int64_t now_us)
+{
+    CanOpenNmtState state = coState.load();
+
+    if (msg.identifier == CANOPEN_COB_NMT)
+        return canOpenProcessNmt(msg);
+
+    if (state == CANOPEN_STOPPED)
+        return;
+
+    if (msg.identifier == (uint32_t)CANOPEN_COB_SDO_RX + coNodeID)
+        return canOpenProcessSdo(msg);
+
+    if (state != CANOPEN_OPERATIONAL)
+        return;
+
+    if (msg.identifier == CANOPEN_COB_SYNC)
+        return canOpenProcessSync(now_us);
+
+    for (int n = 0; n < CANOPEN_MAX_PDO; n++)
+    {
+        if (msg.identifier != (uint32_t)CANOPEN_COB_RPDO(n + 1) + coNodeID)
+            continue;
+
+        portENTER_CRITICAL(&coMux);
+        CanOpenPdoConfig cfg = coRPdos[n];
+        portEXIT_CRITICAL(&coMux);
+
+        canOpenUnpackPdo(cfg, msg);
+        return;
+    }
+}
+
+// Runs in the CAN receiver task, only hands the frame over
+static void canOpenListener(const CanMessage& msg)
+{
+    if (msg.extd || msg.rtr)
+        return;
+
+    uint32_t id = msg.identifier;
+    uint32_t function = id & 0x780;
+    bool forNode = (id & 0x7F) == coNodeID;
+
+    if (id == CANOPEN_COB_NMT || id == CANOPEN_COB_SYNC ||
+        (forNode && (function == CANOPEN_COB_SDO_RX || (function >= 0x200 && function <= 0x500 && (function & 0x080) == 0))))
+        xQueueSend(coRxQueue, &msg, 0);
+}
+
+static void canOpenTask(void* arg)
+{
+    int64_t lastHeartbeat_us = esp_timer_get_time();
+
+    canOpenResetCommunication();
+
+    while (coRunning.load(std::memory_order_acquire))
+    {
+        CanMessage msg;
+        TickType_t wait = pdMS_TO_TICKS(CANOPEN_TICK_MS);
+        while (xQueueReceive(coRxQueue, &msg, wait) == pdTRUE)
+        {
+            canOpenProcessFrame(msg, esp_timer_get_time());
+            wait = 0;
+        }
+
+        int64_t now_us = esp_timer_get_time();
+
+        uint16_t heartbeat_ms = coHeartbeat_ms.load();
+        if (heartbeat_ms > 0 && now_us - lastHeartbeat_us >= (int64_t)heartbeat_ms * 1000)
+        {
+            lastHeartbeat_us = now_us;
+            canOpenSendHeartbeat();
+        }
+
+        if (coState.load() == CANOPEN_OPERATIONAL)
+            canOpenProcessEventPdos(now_us);
+    }
+
+    coTaskHandle = NULL;
+    vTaskDelete(NULL);
+}
+
+bool EQSP32::startCANopen(uint8_t nodeID, uint16_t heartbeat_ms)
+{
+    if (nodeID < 1 || nodeID > 127)
+        return false;
+    if (coRunning.load(std::memory_order_acquire))
+        stopCANopen();
+
+    if (!startCANReceiver() || !startCANTransmitter())
+        return false;
+
+    if (coRxQueue == NULL)
+        coRxQueue = xQueueCreate(CANOPEN_RX_QUEUE_SIZE, sizeof(CanMessage));
+    if (coRxQueue == NULL)
+        return false;
+    xQueueReset(coRxQueue);
+
+    coEQ = this;
+    coNodeID = nodeID;
+    coHeartbeat_ms.store(heartbeat_ms);
+    coRunning.store(true, std::memory_order_release);
+
+    if (xTaskCreatePinnedToCore(canOpenTask, "EQSP32_CANopen", CANOPEN_TASK_STACK, NULL,
+                                CANOPEN_TASK_PRIORITY, &coTaskHandle, tskNO_AFFINITY) != pdPASS)
+    {
+        coRunning.store(false, std::memory_order_release);
+        return false;
+    }
+
+    canAddListener(canOpenListener);
+    return true;
+}
+
+void EQSP32::stopCANopen()
+{
+    canRemoveListener(canOpenListener);
+
+    if (!coRunning.exchange(false))
+        return;
+
+    while (coTaskHandle != NULL)
+        vTaskDelay(pdMS_TO_TICKS(1));
+
+    coState.store(CANOPEN_STOPPED);
+}
+
+CanOpenNmtState EQSP32::getCANopenState()
+{
+    return coState.load();
+}
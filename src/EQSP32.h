@@ -143,6 +143,10 @@ enum PinMode : uint8_t {
 #define IS_PT_VALID(value) (((value) & 0xFF800000) != 0x800000)      // Macro to check if a PT sensor value is valid (we check error bit or if negative temperature)
 
 
+#define USER_NUM_BOOL       32          // User bools in the EQSP32 database, indexes 1 to USER_NUM_BOOL
+#define USER_NUM_INT        32          // User ints in the EQSP32 database, indexes 1 to USER_NUM_INT
+
+
 enum TrigMode {
     STATE,
     ON_RISING,
@@ -172,6 +176,129 @@ enum CanBitRates
     CAN_1000K       // Enumerator for 1000 kbps (1 Mbps)
 };
 
+enum CanTxPriority
+{
+    CAN_TX_HIGH = 0,    // Sent before any other pending frame
+    CAN_TX_NORMAL,
+    CAN_TX_LOW,
+    CAN_TX_PRIORITIES
+};
+
+typedef struct
+{
+    uint32_t framesQueued = 0;          // Frames accepted by the transmit queues (including cyclic frames)
+    uint32_t framesSent = 0;            // Frames the CAN driver reported as sent
+    uint32_t framesDropped = 0;         // Frames rejected because their priority queue was full
+    uint32_t framesRequeued = 0;        // Frames re-queued after a failed transmission, a timeout or a bus-off
+    uint32_t framesAbandoned = 0;       // Frames dropped after failing 3 retries or when no queue space was left to retry
+    uint32_t busOffRecoveries = 0;      // Bus-off recoveries initiated by the transmitter
+    uint32_t pending = 0;               // Frames currently waiting in the transmit queues
+    uint32_t avgLatency_us = 0;         // Average time from queueing to hand-over to the driver, of sent frames
+    uint32_t maxLatency_us = 0;         // Worst time from queueing to hand-over to the driver, of sent frames
+} CanTxStats;
+
+#define CAN_STATS_TOP_IDS   8
+
+typedef struct
+{
+    uint32_t identifier = 0;
+    bool extd = false;
+    uint32_t frameRate = 0;             // Frames/s during the last statistics window
+} CanIdRate;
+
+typedef struct
+{
+    twai_state_t state = TWAI_STATE_STOPPED;
+    float busLoad = 0;                  // % of the bus bandwidth used by the frames seen by this node (stuff bits excluded)
+    uint32_t rxFrameRate = 0;           // Received frames/s during the last statistics window
+    uint32_t txFrameRate = 0;           // Transmitted frames/s during the last statistics window
+    uint32_t rxFrames = 0;              // Total received frames
+    uint32_t txFrames = 0;              // Total frames sent through the transmit scheduler
+    uint32_t rxDropped = 0;             // Frames lost because the receiver ring buffer was full
+    uint32_t rxMissed = 0;              // Frames lost because the driver RX queue was full
+    uint32_t rxOverruns = 0;            // Frames lost because the controller RX FIFO overran
+    uint32_t txFailed = 0;              // Failed transmissions reported by the driver
+    uint32_t arbitrationLost = 0;       // Arbitration losses
+    uint32_t busErrors = 0;             // Bus errors (bit, stuff, CRC, form, ACK)
+    uint32_t errorPassiveCount = 0;     // Times the controller entered the error passive state
+    uint32_t busOffCount = 0;           // Times the controller entered the bus-off state
+    uint32_t txErrorCounter = 0;
+    uint32_t rxErrorCounter = 0;
+    CanIdRate topIDs[CAN_STATS_TOP_IDS];   // Busiest IDs, highest rate first
+} CanStats;
+
+// CANopen slave
+enum CanOpenNmtState : uint8_t
+{
+    CANOPEN_BOOTUP          = 0,
+    CANOPEN_STOPPED         = 4,
+    CANOPEN_OPERATIONAL     = 5,
+    CANOPEN_PRE_OPERATIONAL = 127
+};
+
+// CANopen object dictionary, manufacturer specific area
+#define CANOPEN_OD_PIN          0x2000      // Sub 1-16: EQ_PIN_1 to EQ_PIN_16 value (readPin/pinValue), INTEGER32. Digital pins read back the last value written
+#define CANOPEN_OD_USER_INT     0x2100      // Sub 1-32: user ints (readUserInt/writeUserInt), INTEGER32
+#define CANOPEN_OD_USER_BOOL    0x2200      // Sub 1-32: user bools (readUserBool/writeUserBool), UNSIGNED8
+#define CANOPEN_OD_SUPPLY       0x2300      // Sub 1: input voltage (mV), sub 2: output voltage (mV), read only, INTEGER32
+
+// TPDO transmission types
+#define CANOPEN_PDO_SYNC_ACYCLIC    0       // Sent on SYNC when the mapped data changed
+                                            // 1-240: sent on every n-th SYNC
+#define CANOPEN_PDO_EVENT           255     // Sent when the mapped data changes and/or on the event timer
+
+#define CANOPEN_MAX_PDO         4
+#define CANOPEN_MAX_PDO_MAP     8
+
+typedef struct
+{
+    uint16_t index;                 // Object dictionary index (e.g. CANOPEN_OD_PIN)
+    uint8_t subIndex;               // Object dictionary sub-index (e.g. 3 for EQ_PIN_3)
+    uint8_t bitLength;              // 8, 16 or 32. Mapped objects are packed little-endian in mapping order
+} CanOpenPdoMap;
+
+// J1939
+#define J1939_NULL_ADDRESS      254         // Address used when no address could be claimed
+#define J1939_GLOBAL_ADDRESS    255
+
+typedef struct
+{
+    uint32_t pgn;                   // Parameter group number carrying the SPN
+    uint32_t spn;                   // Suspect parameter number
+    uint16_t startBit;              // Position of the least significant bit in the PGN data (byte * 8 + bit)
+    uint8_t bitLength;              // 1 to 32 bits, little-endian (Intel) byte order
+    float resolution;               // Scaled value = raw * resolution + offset
+    float offset;
+} J1939SpnDescriptor;
+
+enum CanBridgeMode {
+    CAN_BRIDGE_VALUE,           // Latest value of a signal of the frame
+    CAN_BRIDGE_COUNT,           // Frame rate of the ID (frames/s over each publish period)
+};
+
+typedef struct
+{
+    uint32_t canID = 0;
+    bool extendedFrame = false;
+    CanBridgeMode mode = CAN_BRIDGE_VALUE;
+    uint8_t startBit = 0;               // CAN_BRIDGE_VALUE: position of the signal's least significant bit (byte * 8 + bit)
+    uint8_t bitLength = 8;              // 1 to 32 bits, little-endian (Intel) byte order
+    bool isSigned = false;
+    float scale = 1;                    // Published value = raw * scale + offset
+    float offset = 0;
+    std::string entity = "";            // Display sensor the value is published to, created with createDisplay_Sensor
+} CanBridgeEntry;
+
+typedef struct
+{
+    uint32_t framesMatched = 0;         // Frames matching a bridge entry
+    uint32_t framesCoalesced = 0;       // Values overwritten by a newer frame before being published
+    uint32_t updatesPublished = 0;
+    uint32_t publishFailures = 0;       // Entity updates rejected, e.g. unknown entity name
+    uint32_t avgLatency_ms = 0;         // Time from the oldest unpublished frame to its entity update
+    uint32_t maxLatency_ms = 0;
+} CanBridgeStats;
+
 
 enum EQSerialMode {
     RS232,
@@ -180,6 +307,146 @@ enum EQSerialMode {
     RS485_RX,
 };
 
+enum SerialFraming {
+    SERIAL_FRAME_COBS,          // Consistent overhead byte stuffing, frames end with 0x00
+    SERIAL_FRAME_SLIP,          // RFC 1055, frames delimited by 0xC0
+    SERIAL_FRAME_LENGTH,        // 2-byte big-endian length header
+    SERIAL_FRAME_IDLE,          // Frames end when the line is idle for 3 characters
+};
+
+// Receives a complete frame, CRC removed. The data is only valid during the call.
+typedef void (*SerialFrameCallback)(const uint8_t* data, size_t length);
+
+typedef struct
+{
+    uint32_t framesReceived = 0;
+    uint32_t framesSent = 0;
+    uint32_t crcErrors = 0;
+    uint32_t framingErrors = 0;         // Malformed COBS frames, invalid length headers
+    uint32_t overflows = 0;             // Frames longer than maxFrame, or not fully queued for transmission
+} SerialChannelStats;
+
+enum ModbusFunction : uint8_t {
+    MODBUS_READ_COILS = 1,
+    MODBUS_READ_DISCRETE_INPUTS = 2,
+    MODBUS_READ_HOLDING_REGISTERS = 3,
+    MODBUS_READ_INPUT_REGISTERS = 4,
+    MODBUS_WRITE_SINGLE_COIL = 5,
+    MODBUS_WRITE_SINGLE_REGISTER = 6,
+    MODBUS_WRITE_MULTIPLE_COILS = 15,
+    MODBUS_WRITE_MULTIPLE_REGISTERS = 16,
+};
+
+typedef struct
+{
+    uint32_t requests = 0;
+    uint32_t responses = 0;             // Valid responses, including exception responses
+    uint32_t timeouts = 0;
+    uint32_t crcErrors = 0;             // Responses with a bad CRC or an unexpected header/length
+    uint32_t exceptions = 0;
+    uint8_t lastException = 0;          // Last Modbus exception code returned by the slave
+    uint32_t avgLatency_us = 0;         // Average time from request start to complete response
+    uint32_t maxLatency_us = 0;
+} ModbusSlaveStats;
+
+// Modbus slave/server register map
+#define MODBUS_MAP_PIN          0x0000      // Address 0-15: EQ_PIN_1 to EQ_PIN_16. Coils/discrete inputs: state, holding registers: readPin/pinValue, input registers: readPin (mV, C). Digital pins read back the last value written
+#define MODBUS_MAP_USER_BOOL    0x0100      // Coils 0x100-0x11F: user bools
+#define MODBUS_MAP_USER_INT     0x0200      // Holding registers 0x200-0x23F: user ints, two registers each, high word first
+#define MODBUS_MAP_SUPPLY       0x0300      // Input registers 0x300: input voltage, 0x301: output voltage (mV)
+
+typedef struct
+{
+    int year = 1970;
+    int month = 1;                      // 1-12
+    int day = 1;                        // 1-31
+    int hour = 0;                       // 0-23
+    int mins = 0;                       // 0-59
+    int secs = 0;                       // 0-60
+    int weekDay = 4;                    // 0-6, Sunday is 0
+    int yearDay = 0;                    // 0-365
+    bool isDst = false;                 // Daylight saving time in effect
+    bool synced = false;                // Same as isLocalTimeSynced() at the time of the update
+    time_t unixTime = 0;
+} EQTime;
+
+// Day masks for weekly schedules, bit n is EQTime::weekDay n
+#define SCHEDULE_SUNDAY         0x01
+#define SCHEDULE_MONDAY         0x02
+#define SCHEDULE_TUESDAY        0x04
+#define SCHEDULE_WEDNESDAY      0x08
+#define SCHEDULE_THURSDAY       0x10
+#define SCHEDULE_FRIDAY         0x20
+#define SCHEDULE_SATURDAY       0x40
+#define SCHEDULE_WEEKDAYS       0x3E
+#define SCHEDULE_WEEKEND        0x41
+#define SCHEDULE_EVERY_DAY      0x7F
+
+// Called when a schedule window starts (active = true) and ends (active = false), from the scheduler task
+typedef void (*EQScheduleCallback)(int id, bool active, void* arg);
+
+typedef struct
+{
+    bool enabled = false;
+    bool active = false;                // Inside a schedule window
+    time_t nextStart = 0;               // Unix time of the next window start, 0 while the local time is not synced or if none is found
+    time_t activeUntil = 0;             // Unix time the current window ends, 0 if not active
+} EQScheduleStatus;
+
+#define MEMORY_STATS_MAX_TASKS  24
+
+typedef struct
+{
+    char name[configMAX_TASK_NAME_LEN] = "";
+    uint32_t stackHeadroom = 0;         // Minimum free stack since the task started, in bytes
+} TaskStackStats;
+
+typedef struct
+{
+    uint32_t internalFree = 0;          // Internal SRAM, in bytes
+    uint32_t internalLargestBlock = 0;  // Largest allocation that can currently succeed
+    uint32_t internalMinFree = 0;       // Minimum free since boot
+    float internalFragmentation = 0;    // 100 * (1 - largest block / free), in %
+    uint32_t psramSize = 0;             // 0 if the module has no PSRAM
+    uint32_t psramFree = 0;
+    uint32_t psramLargestBlock = 0;
+    uint32_t psramMinFree = 0;
+    float psramFragmentation = 0;
+    int taskCount = 0;
+    TaskStackStats tasks[MEMORY_STATS_MAX_TASKS];   // Library and system tasks found running
+} MemoryStats;
+
+enum MemorySubsystem {
+    MEMORY_CAN,                 // CAN receive ring, internal SRAM by default
+    MEMORY_SERIAL,              // Serial channel frame buffers, internal SRAM by default
+    MEMORY_J1939,               // J1939 SPN tables and transport protocol buffers, PSRAM by default
+    MEMORY_LIBRARY,             // malloc() of the whole application (library core, sketch, lwIP), core default until configured
+    MEMORY_SUBSYSTEMS,
+};
+
+enum MemoryPlacement {
+    MEMORY_INTERNAL,            // Internal SRAM, for buffers used on every frame
+    MEMORY_PREFER_PSRAM,        // PSRAM when present and with room, internal SRAM otherwise
+    MEMORY_DEFAULT,             // Restores the placement the subsystem starts with
+};
+
+typedef struct
+{
+    uint32_t internalBytes = 0;         // Currently allocated in internal SRAM
+    uint32_t psramBytes = 0;            // Currently allocated in PSRAM
+    uint32_t failures = 0;              // Allocations that failed in both
+} MemoryPlacementStats;
+
+typedef struct
+{
+    uint32_t updates = 0;               // Values saved through the settings cache
+    uint32_t unchanged = 0;             // Updates equal to the current value, dropped
+    uint32_t coalesced = 0;             // Pending values replaced by a newer update before being written
+    uint32_t flashWrites = 0;           // NVS key writes and erases
+    uint32_t commits = 0;
+    uint32_t pending = 0;               // Values waiting for the next commit
+} SettingsCacheStats;
+
 typedef struct
 {
     std::string databaseURL = "";
@@ -627,6 +894,113 @@ public:
      */
     void writeUserInt(int idx, int value);
 
+    /**
+     * @brief Reads a range of consecutive user-defined boolean values from the EQSP32 database.
+     *
+     * Bulk version of `readUserBool(idx, STATE)`. Values are copied into `out` starting with index `start`.
+     * Unlike `readUserBool`, it does not touch the edge state of the trigger modes, so `readUserBool(idx, ON_RISING)`
+     * calls elsewhere in the sketch keep detecting their edges.
+     *
+     * @param start The first index to read (1 to USER_NUM_BOOL).
+     * @param count The number of consecutive values to read. Indexes beyond USER_NUM_BOOL are not read.
+     * @param out Buffer receiving at least `count` values.
+     *
+     * @return The number of values copied into `out`, 0 if the arguments are invalid.
+     *
+     * @example
+     * Usage example:
+     * bool recipeFlags[8];
+     * eqsp32.readUserBools(1, 8, recipeFlags);     // Reads user bools 1 to 8
+     */
+    int readUserBools(int start, int count, bool* out);
+
+    /**
+     * @brief Reads a range of consecutive user-defined integer values from the EQSP32 database.
+     *
+     * Bulk version of `readUserInt`.
+     *
+     * @param start The first index to read (1 to USER_NUM_INT).
+     * @param count The number of consecutive values to read. Indexes beyond USER_NUM_INT are not read.
+     * @param out Buffer receiving at least `count` values.
+     *
+     * @return The number of values copied into `out`, 0 if the arguments are invalid.
+     */
+    int readUserInts(int start, int count, int* out);
+
+    /**
+     * @brief Writes a range of consecutive user-defined boolean values to the EQSP32 database.
+     *
+     * Bulk version of `writeUserBool`. Only values that differ from the current database content are written,
+     * so unchanged entries of a large table do not generate cloud updates.
+     *
+     * @param start The first index to write (1 to USER_NUM_BOOL).
+     * @param values The values to write.
+     * @param n The number of values to write. Values beyond USER_NUM_BOOL are ignored.
+     *
+     * @return The number of values that actually changed.
+     */
+    int writeUserBools(int start, const bool* values, int n);
+
+    /**
+     * @brief Writes a range of consecutive user-defined integer values to the EQSP32 database.
+     *
+     * Bulk version of `writeUserInt`. Only values that differ from the current database content are written,
+     * so unchanged entries of a large table do not generate cloud updates.
+     *
+     * @param start The first index to write (1 to USER_NUM_INT).
+     * @param values The values to write.
+     * @param n The number of values to write. Values beyond USER_NUM_INT are ignored.
+     *
+     * @return The number of values that actually changed.
+     *
+     * @example
+     * Usage example:
+     * int recipe[4] = {120, 45, 300, 0};
+     * eqsp32.writeUserInts(10, recipe, 4);        // Writes user ints 10 to 13
+     */
+    int writeUserInts(int start, const int* values, int n);
+
+    /**
+     * @brief Subscribes to edges of a user-defined boolean value.
+     *
+     * Every subscription gets its own edge state, so several parts of an application may watch the same user bool
+     * without stealing each other's edges (see the note on `readUserBool`). Subscribed values are sampled by a
+     * background task, and detected edges are latched per subscription until they are consumed with `readUserBoolEvent`,
+     * so edges are not lost while `loop()` is busy. Sampling leaves the edge state of `readUserBool` untouched, so
+     * subscriptions and `readUserBool(idx, ON_RISING)` calls on the same index do not interfere.
+     *
+     * @param idx The index of the user-defined boolean value to watch (1 to USER_NUM_BOOL).
+     * @param trigMode The edge to latch. ON_RISING, ON_FALLING or ON_TOGGLE. With STATE, `readUserBoolEvent` returns the last sampled value.
+     *
+     * @return A subscription token (>= 0), or -1 if the index is invalid, all subscription slots are in use or the sampling task could not be started.
+     *
+     * @example
+     * Usage example:
+     * int startToken = eqsp32.subscribeUserBool(1, ON_RISING);
+     * int stopToken = eqsp32.subscribeUserBool(1, ON_FALLING);
+     * ...
+     * if (eqsp32.readUserBoolEvent(startToken)) startPump();
+     * if (eqsp32.readUserBoolEvent(stopToken)) stopPump();
+     */
+    int subscribeUserBool(int idx, TrigMode trigMode = ON_TOGGLE);
+
+    /**
+     * @brief Consumes one latched edge of a user bool subscription.
+     *
+     * @param token The token returned by `subscribeUserBool`.
+     *
+     * @return true if an edge matching the subscription's trigger mode was latched since the last call, false otherwise or if the token is invalid.
+     * For STATE subscriptions, returns the last sampled value.
+     */
+    bool readUserBoolEvent(int token);
+
+    /**
+     * @brief Releases a user bool subscription.
+     *
+     * @param token The token returned by `subscribeUserBool`. Any latched edges are discarded.
+     */
+    void unsubscribeUserBool(int token);
+
         // DAC
     /**
      * @brief Sets the output voltage for a specified pin on the EQSP32 module using DAC functionality.
@@ -757,147 +1131,1006 @@ public:
      */
     bool configSerial(EQSerialMode mode = RS232, int baud = 115200);
 
-    bool configCAN(CanBitRates CAN_BITRATE);
-    bool configCAN(CanBitRates CAN_BITRATE, uint32_t canID, bool canOpenFrame=false);
-
-    bool transmitCANFrame(CanMessage canMessage);
-    bool receiveCANFrame(CanMessage &canMessage);
-
-    // TODO add function description
-    EQ_WifiStatus getWiFiStatus();
-
     /**
-     * @brief Prints the current local time to the serial output in a human-readable format.
-     * 
-     * This function retrieves the current local time using the configured NTP server or default system time if the NTP is not synchronized. 
-     * If the local time cannot be obtained, it logs an error message. Otherwise, it prints the time in the format:
-     * "Day, Month Date Year Hour:Minute:Second".
-     * 
-     * @note The function uses a timeout to retrieve the local time. If synchronization fails within this time, 
-     *       the function logs an error and exits.
-     * 
-     * @attention Ensure that the NTP server has been successfully configured and the system time is synchronized to get an accurate timestamp.
-     * 
+     * @brief Configures the RS485 port with automatic direction control by the UART.
+     *
+     * The UART runs in RS485 half-duplex mode and drives the transceiver enable pin (EQ_RS485_EN) itself, asserting it
+     * for the duration of each transmission and releasing it right after the last stop bit. There is no need to
+     * switch between `RS485_TX` and `RS485_RX` with `configSerial`, and the turnaround shrinks from a port
+     * reconfiguration to about one bit time. The Modbus master and slave use this mode once it is enabled.
+     *
+     * @param baud The baud rate for serial communication.
+     * @param invertEnable Set if the transceiver driver enable is active low.
+     *
+     * @return true if the port is in automatic direction mode, false otherwise (the port is then left in RS485_RX).
+     *
+     * @attention The mode stays enabled for the Modbus master/slave and `startSerialChannel` until `disableRS485Auto()`
+     *          is called, even if `configSerial` is used in between.
+     *
      * @example
-     * EQSP32 eqsp32;
-     * eqsp32.printLocalTime(); // Prints the current local time or logs an error if unavailable.
+     * Usage example:
+     * eqsp32.configRS485Auto(9600);
+     * eqsp32.Serial.write(frame, sizeof(frame));    // No direction switching around writes
+     * if (eqsp32.readRS485Collision())
+     *     Serial.println("Bus collision during the last transmission");
      */
-    void printLocalTime();
+    bool configRS485Auto(int baud = 115200, bool invertEnable = false);
 
     /**
-     * @brief Checks if the local time is synchronized with the NTP server.
-     * 
-     * This function verifies whether the local system time has been synchronized with the NTP server
-     * or if only the default system time is available.
-     * 
-     * @return true if the local time is synchronized with the NTP server, false only default time is available.
-     * 
-     * @attention This function is helpful to determine whether the timestamps used for logging and operations are accurate.
-     * 
-     * @example
-     * EQSP32 eqsp32;
-     * if (eqsp32.isLocalTimeSynced()) {
-     *     // Proceed with time-dependent operations
-     * } else {
-     *     // Handle unsynchronized time
-     * }
+     * @brief Leaves the automatic RS485 direction mode of `configRS485Auto`.
+     *
+     * The UART returns to the regular mode and the port is left in `RS485_RX` at the current baud rate, with the
+     * direction switched by `configSerial` again.
      */
-    bool isLocalTimeSynced();
+    void disableRS485Auto();
 
     /**
-     * @brief Retrieves the current hour from the local time.
-     * 
-     * This function returns the current hour (0-23) based on the local system time. If the local time cannot be 
-     * obtained within the timeout, the function logs an error and returns 0.
-     * 
-     * @return The current local hour (0-23) if successful, 0 otherwise.
-     * 
-     * @attention This function will return the default time if isLocalTimeSynced() is false!
-     * 
-     * @example
-     * EQSP32 eqsp32;
-     * int hour = eqsp32.getLocalHour();
-     * ::Serial.printf("Current Hour: %d\n", hour);
-     * 
-     * @example
-     * // Check synchronization first
-     * EQSP32 eqsp32;
-     * if (eqsp32.isLocalTimeSynced()) {
-     *     int hour = eqsp32.getLocalHour();
-     *     ::Serial.printf("Current Hour: %d\n", hour);
-     * } else {
-     *     ::Serial.println("Local time is not synchronized. Unable to fetch actual local hour.");
-     * }
+     * @brief Returns true if the UART detected a collision (received data differing from the transmitted data)
+     *          during the last RS485 transmission in automatic direction mode.
      */
-    int getLocalHour();
+    bool readRS485Collision();
 
-        /**
-     * @brief Retrieves the current minutes from the local time.
-     * 
-     * This function returns the current minutes (0-59) based on the local system time. If the local time cannot be 
-     * obtained within the timeout, the function logs an error and returns 0.
-     * 
-     * @return The current local minutes (0-59) if successful, 0 otherwise.
-     * 
-     * @attention This function will return the default time if isLocalTimeSynced() is false!
-     * 
-     * @example
-     * EQSP32 eqsp32;
-     * int mins = eqsp32.getLocalMins();
-     * ::Serial.printf("Current Minutes: %d\n", mins);
-     * 
+    /**
+     * @brief Starts a framed packet channel on `EQSP32::Serial`.
+     *
+     * The port is configured like `configSerial(mode, baud)` with 4KB UART driver RX/TX buffers. Received bytes are
+     * decoded in the UART event task as they arrive, and each complete frame with a valid CRC is passed to `callback`
+     * straight from the decode buffer. With RS485, the port receives by default and switches to transmit around each
+     * `sendSerialFrame` (no switching in `configRS485Auto` mode).
+     *
+     * @param mode The serial mode (RS232, RS232_INV, or RS485_TX/RS485_RX for the RS485 port).
+     * @param baud The baud rate (8N1).
+     * @param framing How frames are delimited on the line.
+     * @param callback Called from the UART event task for every valid frame. It must return quickly and must not
+     *          keep the data pointer.
+     * @param crc Append a CRC-16/CCITT-FALSE (big-endian) to sent frames and check it on received ones.
+     * @param maxFrame The largest frame payload, in bytes. Longer received frames are dropped.
+     *
+     * @return true if the channel is running, false if the arguments are invalid, the port is used by another
+     *          protocol (Modbus) or the buffers could not be allocated.
+     *
      * @example
-     * // Check synchronization first
-     * EQSP32 eqsp32;
-     * if (eqsp32.isLocalTimeSynced()) {
-     *     int mins = eqsp32.getLocalMins();
-     *     ::Serial.printf("Current Minutes: %d\n", mins);
-     * } else {
-     *     ::Serial.println("Local time is not synchronized. Unable to fetch actual local minutes.");
+     * Usage example:
+     * void onFrame(const uint8_t* data, size_t length) {
+     *     // Parse the packet
      * }
+     * ...
+     * eqsp32.startSerialChannel(RS232, 921600, SERIAL_FRAME_COBS, onFrame);
+     * eqsp32.sendSerialFrame(packet, sizeof(packet));
      */
-    int getLocalMins();
+    bool startSerialChannel(EQSerialMode mode, int baud, SerialFraming framing, SerialFrameCallback callback,
+                            bool crc = true, size_t maxFrame = 512);
 
-    long getLocalUnixTimestamp();
-    std::string getFormattedLocalTime();
-    long getUnixTimestamp();
-    std::string getFormattedUnixTimestamp();
+    /**
+     * @brief Stops the framed packet channel. The port keeps its configuration and buffers.
+     */
+    void stopSerialChannel();
 
-private:
-    class EQ_Private;       // Forward declaration of the nested private class
-    EQ_Private* eqPrivate;
-};
+    /**
+     * @brief Encodes and sends a frame on the packet channel. Can be called from any task.
+     *
+     * @return true if the whole frame was queued for transmission, false if the channel is not running or the frame is too long.
+     */
+    bool sendSerialFrame(const uint8_t* data, size_t length);
 
+    /**
+     * @brief Returns the packet channel frame and error counters.
+     */
+    SerialChannelStats getSerialChannelStats();
 
-/**
- * @brief EQTimer class for managing timing operations.
- * 
- * The EQTimer class provides methods to start, stop, pause, reset, and check the status of a timer.
- * It is useful for timing events and managing delays in the EQSP32 application.
- */
-class EQTimer {
-public:
     /**
-     * @brief Constructs a EQTimer object with an optional preset value.
-     * 
-     * Initializes a EQTimer object, setting an optional preset value for the timer.
-     * The timer is initially stopped.
-     * 
-     * @param preset Optional preset value in milliseconds for the timer. Default is 0.
-     * 
+     * @brief Starts the Modbus RTU master on the RS485 port.
+     *
+     * The master runs in its own task and serves the poll table added with `addModbusPoll` and the writes queued with
+     * `writeModbusRegister`/`writeModbusCoil`. Requests are sent back to back, separated only by the 3.5 character
+     * inter-frame gap computed from the baud rate (1750us above 19200 baud). A response is complete as soon as its
+     * expected length is received, so the next request does not wait for the timeout.
+     *
+     * @param baud The RS485 baud rate (8N1).
+     * @param timeout_ms The time to wait for a slave response before counting a timeout.
+     *
+     * @return true if the master is running, false if the port is used by the Modbus slave or packet channel, or the task could not be created.
+     *
+     * @attention The master owns `EQSP32::Serial` and switches the RS485 direction through `configSerial` while it runs,
+     *          unless `configRS485Auto` was called. Do not use the port from the application until `stopModbusMaster()` is called.
+     *
      * @example
      * Usage example:
-     * 
-     * @code
-     * EQTimer myTimer(5000); // Creates a EQTimer object with a 5 second preset
-     * @endcode
+     * eqsp32.startModbusMaster(19200);
+     * eqsp32.addModbusPoll(1, MODBUS_READ_HOLDING_REGISTERS, 0, 10, 100);    // Registers 0-9 of slave 1 every 100ms
+     * eqsp32.addModbusPoll(1, MODBUS_READ_HOLDING_REGISTERS, 10, 4, 100);    // Merged with the above into one request
+     * ...
+     * uint16_t value;
+     * uint32_t age;
+     * if (eqsp32.readModbusValue(1, MODBUS_READ_HOLDING_REGISTERS, 12, value, &age) && age < 500)
+     *     Serial.println(value);
      */
-    EQTimer(unsigned long preset = 0);
+    bool startModbusMaster(int baud = 9600, uint32_t timeout_ms = 100);
 
     /**
-     * @brief Starts the timer with an optional preset value.
-     * 
-     * Starts the timer if it is not already running.
+     * @brief Stops the Modbus RTU master. The poll table and cached values are kept.
+     */
+    void stopModbusMaster();
+
+    /**
+     * @brief Adds a range of coils, discrete inputs or registers to the Modbus master poll table.
+     *
+     * A poll that overlaps or adjoins an existing poll of the same slave, function and period is merged into it,
+     * as long as the merged request stays within the Modbus limits (125 registers or 2000 bits).
+     *
+     * @param slave The slave address (1 to 247).
+     * @param function One of MODBUS_READ_COILS, MODBUS_READ_DISCRETE_INPUTS, MODBUS_READ_HOLDING_REGISTERS or MODBUS_READ_INPUT_REGISTERS.
+     * @param address The first coil/register address (0-based, as sent on the wire).
+     * @param count The number of coils/registers.
+     * @param period_ms The poll period. Late polls are not repeated to catch up.
+     *
+     * @return true if the poll was added or merged, false if the arguments are invalid or the poll table is full.
+     */
+    bool addModbusPoll(uint8_t slave, ModbusFunction function, uint16_t address, uint16_t count, uint32_t period_ms);
+
+    /**
+     * @brief Removes every entry of the Modbus master poll table and its cached values.
+     */
+    void clearModbusPolls();
+
+    /**
+     * @brief Reads a cached value of the Modbus master poll table.
+     *
+     * @param slave The slave address.
+     * @param function The read function the value is polled with.
+     * @param address The coil/register address.
+     * @param value Receives the register value, or 0/1 for coils and discrete inputs.
+     * @param age_ms Optional, receives the time in milliseconds since the value was last read from the slave.
+     *
+     * @return true if the value was read at least once, false if it is not polled or no valid response was received yet.
+     */
+    bool readModbusValue(uint8_t slave, ModbusFunction function, uint16_t address, uint16_t& value, uint32_t* age_ms = nullptr);
+
+    /**
+     * @brief Queues a single register write (function 6). Writes are sent ahead of the pending polls.
+     *
+     * @return true if the write was queued, false if the master is not running or the write queue is full.
+     */
+    bool writeModbusRegister(uint8_t slave, uint16_t address, uint16_t value);
+
+    /**
+     * @brief Queues a single coil write (function 5). Writes are sent ahead of the pending polls.
+     *
+     * @return true if the write was queued, false if the master is not running or the write queue is full.
+     */
+    bool writeModbusCoil(uint8_t slave, uint16_t address, bool value);
+
+    /**
+     * @brief Returns the Modbus master request, error and latency statistics of a slave.
+     */
+    ModbusSlaveStats getModbusSlaveStats(uint8_t slave);
+
+    /**
+     * @brief Starts a Modbus RTU slave on the RS485 port, exposing the pins, user variables and supply voltages.
+     *
+     * The register map is:
+     * - Coils 0-15 (MODBUS_MAP_PIN): pin states, writing ON sets `pinValue(pin, 1000)`, OFF sets 0.
+     * - Coils 0x100-0x11F (MODBUS_MAP_USER_BOOL): user bools 1-32.
+     * - Discrete inputs 0-15: pin states.
+     * - Holding registers 0-15: `readPin`/`pinValue` of each pin.
+     * - Holding registers 0x200-0x23F (MODBUS_MAP_USER_INT): user ints 1-32, two registers each, high word first.
+     *   Write both registers of a user int with one request (function 16) so the value is updated at once.
+     * - Input registers 0-15: `readPin` of each pin (mV for AIN, C for TIN).
+     * - Input registers 0x300-0x301 (MODBUS_MAP_SUPPLY): input and output voltage in mV.
+     *
+     * Requests are answered from a scan image refreshed every 10ms by a background task, by a task woken by the UART at
+     * the end of each frame, so response time does not depend on `loop()`. With `configRS485Auto` the reply path does not
+     * block and runs at high priority. With manual direction control it runs at priority 4 ("EQSP32_MbSlave"), below the
+     * network stack like the other protocol tasks. Writes are queued and applied by the scan task before its next snapshot.
+     *
+     * @param address The slave address (1 to 247). Broadcast writes (address 0) are applied without a response.
+     * @param baud The RS485 baud rate (8N1).
+     *
+     * @return true if the slave is running, false if the address is invalid, the port is used by the Modbus master or packet channel,
+     *          or the tasks could not be created.
+     *
+     * @attention The slave owns `EQSP32::Serial` until `stopModbusSlave()` is called.
+     * Only analog input pins (AIN, RAIN, TIN) are sampled into the scan image. `readPin` resets the edge state of its
+     * trigger modes, so digital pins are not read by the server, to keep `readPin(pin, ON_RISING)` and similar calls in
+     * `loop()` working; their coils and registers return the value last written through Modbus. Mirror digital inputs into
+     * user bools (`writeUserBool`) to publish them. User variables are sampled without affecting `readUserBool` edges.
+     *
+     * @example
+     * Usage example:
+     * eqsp32.pinMode(EQ_PIN_1, AIN);
+     * eqsp32.startModbusSlave(10, 19200);    // Input register 0 now returns the EQ_PIN_1 voltage
+     */
+    bool startModbusSlave(uint8_t address, int baud = 9600);
+
+    /**
+     * @brief Stops the Modbus RTU slave.
+     */
+    void stopModbusSlave();
+
+    /**
+     * @brief Starts a Modbus TCP server on the WiFi interface, with the register map of `startModbusSlave`.
+     *
+     * Up to 4 clients can be connected at the same time. The unit ID of the requests is not checked. Reads are served
+     * from the same scan image as the RTU slave, without accessing the I/O, and writes are queued and applied by the
+     * scan task before its next snapshot. The RTU slave and the TCP server can run together.
+     *
+     * @param port The TCP port to listen on.
+     *
+     * @return true if the server is running, false if the tasks could not be created.
+     *
+     * @attention Connections with no request for 60 seconds are closed.
+     *
+     * @example
+     * Usage example:
+     * eqsp32.startModbusTCP();       // Listen on port 502
+     */
+    bool startModbusTCP(uint16_t port = 502);
+
+    /**
+     * @brief Stops the Modbus TCP server and closes its connections.
+     */
+    void stopModbusTCP();
+
+    bool configCAN(CanBitRates CAN_BITRATE);
+    bool configCAN(CanBitRates CAN_BITRATE, uint32_t canID, bool canOpenFrame=false);
+
+    bool transmitCANFrame(CanMessage canMessage);
+    bool receiveCANFrame(CanMessage &canMessage);
+
+    /**
+     * @brief Starts the CAN receiver task.
+     *
+     * The receiver is a high priority task that drains the CAN driver as frames arrive, applies the acceptance
+     * filter table (see `addCANFilter`) and stores accepted frames in a lock-free ring buffer.
+     * Frames are then consumed in batches with `receiveCANFrames`, so a busy `loop()` no longer overflows the driver queue.
+     *
+     * @param ringSize Number of frames the ring buffer can hold. Rounded up to a power of two. Default is 512.
+     *          Restarting with a different size reallocates the buffer once pending `receiveCANFrames` calls have returned.
+     *
+     * @return true if the receiver is running, false if the ring buffer could not be allocated.
+     *
+     * @attention Call `configCAN` before starting the receiver. While the receiver runs it owns the driver queue,
+     *          so `receiveCANFrame` will not return any frames.
+     *
+     * @example
+     * Usage example:
+     * eqsp32.configCAN(CAN_500K);
+     * eqsp32.addCANFilterRange(0x180, 0x1FF);     // Accept TPDO1 of all CANopen nodes
+     * eqsp32.startCANReceiver();
+     */
+    bool startCANReceiver(size_t ringSize = 512);
+
+    /**
+     * @brief Stops the CAN receiver task. Frames left in the ring buffer are discarded.
+     */
+    void stopCANReceiver();
+
+    /**
+     * @brief Receives all buffered CAN frames, up to `max`, without blocking.
+     *
+     * @param buf Buffer receiving the frames, in arrival order.
+     * @param max Maximum number of frames to copy into `buf`.
+     *
+     * @return The number of frames copied, 0 if none are pending or the receiver is not running.
+     *
+     * @example
+     * Usage example:
+     * CanMessage frames[32];
+     * size_t n = eqsp32.receiveCANFrames(frames, 32);
+     * for (size_t i = 0; i < n; i++)
+     *     handleFrame(frames[i]);
+     */
+    size_t receiveCANFrames(CanMessage* buf, size_t max);
+
+    /**
+     * @brief Adds a CAN ID to the receiver's acceptance filter table.
+     *
+     * While the filter table is empty all frames are accepted. Once an ID or range is added, only matching frames
+     * are stored. Exact IDs are looked up in a hash table, so large tables do not slow down the receiver.
+     *
+     * @param canID The CAN identifier to accept.
+     * @param extendedFrame true for a 29-bit identifier, false for an 11-bit identifier. Default is false.
+     *
+     * @return true if the ID was added, false if the table is full.
+     */
+    bool addCANFilter(uint32_t canID, bool extendedFrame = false);
+
+    /**
+     * @brief Adds an inclusive range of CAN IDs to the receiver's acceptance filter table.
+     *
+     * @param firstID The first CAN identifier of the range.
+     * @param lastID The last CAN identifier of the range.
+     * @param extendedFrame true for 29-bit identifiers, false for 11-bit identifiers. Default is false.
+     *
+     * @return true if the range was added, false if the range is invalid or the table is full.
+     */
+    bool addCANFilterRange(uint32_t firstID, uint32_t lastID, bool extendedFrame = false);
+
+    /**
+     * @brief Clears the acceptance filter table, so that all frames are accepted.
+     */
+    void clearCANFilters();
+
+    /**
+     * @brief Starts the CAN transmit scheduler.
+     *
+     * The scheduler keeps one software queue per `CanTxPriority` and always hands the highest priority frame to the
+     * CAN driver first. One frame is passed to the driver at a time, so a late high priority frame does not wait behind
+     * a driver queue. The driver's transmit alerts tell whether that frame was sent; frames that failed, were lost
+     * on bus-off or are not acknowledged within 100 ms are re-queued, up to 3 times before they are dropped
+     * (`CanTxStats::framesAbandoned`), so a frame nobody acknowledges does not block the queues. Cyclic frames (see `addCANCyclicFrame`) are sent by the scheduler at their set rate.
+     * On bus-off the scheduler initiates recovery.
+     *
+     * @param queueSize Number of frames each priority queue can hold. Default is 64.
+     *
+     * @return true if the scheduler is running, false otherwise.
+     *
+     * @attention Call `configCAN` before starting the scheduler. While it runs, the scheduler owns the TWAI alerts
+     * (`twai_reconfigure_alerts`), and frames sent with `transmitCANFrame` delay the scheduler until the driver queue is
+     * empty. Aborting an unacknowledged frame restarts the driver, which also discards frames waiting in the driver queue.
+     * Use `queueCANFrame` for all frames so their order and priority are kept.
+     */
+    bool startCANTransmitter(size_t queueSize = 64);
+
+    /**
+     * @brief Stops the CAN transmit scheduler. Pending frames are discarded.
+     */
+    void stopCANTransmitter();
+
+    /**
+     * @brief Queues a CAN frame for transmission without blocking.
+     *
+     * @param canMessage The frame to transmit.
+     * @param priority The priority class of the frame. Default is CAN_TX_NORMAL.
+     *
+     * @return true if the frame was queued, false if the scheduler is not running or the priority queue is full (counted as dropped).
+     *
+     * @example
+     * Usage example:
+     * CanMessage msg = {};
+     * msg.identifier = 0x080;
+     * msg.data_length_code = 0;
+     * eqsp32.queueCANFrame(msg, CAN_TX_HIGH);
+     */
+    bool queueCANFrame(const CanMessage& canMessage, CanTxPriority priority = CAN_TX_NORMAL);
+
+    /**
+     * @brief Adds a frame that the transmit scheduler sends periodically.
+     *
+     * @param canMessage The frame to transmit. Its content may be changed later with `updateCANCyclicFrame`.
+     * @param period_ms The transmission period in milliseconds.
+     * @param priority The priority class of the frame. Default is CAN_TX_NORMAL.
+     *
+     * @return A handle (>= 0) for the cyclic frame, or -1 if the period is 0 or all cyclic slots are in use.
+     *
+     * @example
+     * Usage example:
+     * CanMessage status = {};
+     * status.identifier = 0x181;
+     * status.data_length_code = 2;
+     * int statusFrame = eqsp32.addCANCyclicFrame(status, 100);      // Sent every 100 ms
+     * ...
+     * status.data[0] = eqsp32.readPin(EQ_PIN_1);
+     * eqsp32.updateCANCyclicFrame(statusFrame, status);
+     */
+    int addCANCyclicFrame(const CanMessage& canMessage, uint32_t period_ms, CanTxPriority priority = CAN_TX_NORMAL);
+
+    /**
+     * @brief Replaces the content of a cyclic frame. The new content is used from the next period on.
+     *
+     * @param handle The handle returned by `addCANCyclicFrame`.
+     * @param canMessage The new frame content.
+     *
+     * @return true if the handle is valid, false otherwise.
+     */
+    bool updateCANCyclicFrame(int handle, const CanMessage& canMessage);
+
+    /**
+     * @brief Removes a cyclic frame from the transmit scheduler.
+     *
+     * @param handle The handle returned by `addCANCyclicFrame`.
+     */
+    void removeCANCyclicFrame(int handle);
+
+    /**
+     * @brief Returns the transmit scheduler statistics (queue latency, dropped and re-queued frames).
+     */
+    CanTxStats getCANTxStats();
+
+    /**
+     * @brief Returns CAN bus load, frame rates, error statistics and the busiest CAN IDs.
+     *
+     * Rates and bus load are computed by the CAN receiver over one second windows, from the frames this node receives
+     * and the frames sent through the transmit scheduler. The busiest IDs are tracked with a compact top-N counter,
+     * so the cost does not depend on the number of IDs on the bus. Error counters come from the CAN driver,
+     * and error passive/bus-off transitions are sampled by the receiver task.
+     *
+     * @param CAN_BITRATE The bit rate the bus was configured with in `configCAN`, used to compute the bus load.
+     *
+     * @return The CAN statistics. Rates, bus load and top IDs remain 0 while the CAN receiver is not running.
+     *
+     * @attention Frames rejected by the hardware ID filter of `configCAN(bitrate, canID)` are not seen by the receiver
+     *          and are not included in the bus load.
+     *
+     * @example
+     * Usage example:
+     * CanStats stats = eqsp32.getCANStats(CAN_500K);
+     * Serial.printf("Bus load: %.1f%%, RX %u fps, bus-off %u\n", stats.busLoad, stats.rxFrameRate, stats.busOffCount);
+     */
+    CanStats getCANStats(CanBitRates CAN_BITRATE);
+
+    /**
+     * @brief Starts the CANopen slave on the configured CAN bus.
+     *
+     * The slave implements NMT, heartbeat producer, SYNC consumer, an expedited SDO server and up to 4 TPDOs and 4 RPDOs
+     * with the predefined connection set (TPDOn: 0x180/0x280/0x380/0x480 + node ID, RPDOn: 0x200/0x300/0x400/0x500 + node ID).
+     * The object dictionary is fixed at compile time and exposes the EQSP32 pins, user variables and power supply
+     * voltages (see CANOPEN_OD_PIN and the following definitions). PDOs are exchanged by a background task, so process
+     * data follows the bus without any code in `loop()`.
+     *
+     * The CAN receiver and transmit scheduler are started if they are not running.
+     * The node sends its boot-up message and enters the pre-operational state, waiting for an NMT start command.
+     *
+     * @param nodeID The CANopen node ID (1 to 127).
+     * @param heartbeat_ms The heartbeat producer period in milliseconds (object 0x1017), 0 to disable. Default is 1000.
+     *
+     * @return true if the slave is running, false if the node ID is invalid or the CAN tasks could not be started.
+     *
+     * @attention Call `configCAN` first. Pins must be configured with `pinMode` before they are mapped.
+     * Only analog input pins (AIN, RAIN, TIN) are sampled. `readPin` resets the edge state of its trigger modes, so digital
+     * pins are not read by the slave, to keep `readPin(pin, ON_RISING)` and similar calls in `loop()` working; they return
+     * the value last written through CANopen. Mirror digital inputs into user bools (`writeUserBool`) to publish them.
+     *
+     * @example
+     * Usage example:
+     * eqsp32.configCAN(CAN_250K);
+     * CanOpenPdoMap inputs[] = {{CANOPEN_OD_PIN, 1, 16}, {CANOPEN_OD_PIN, 2, 16}};     // AIN values of pins 1 and 2
+     * CanOpenPdoMap outputs[] = {{CANOPEN_OD_PIN, 9, 16}, {CANOPEN_OD_PIN, 10, 16}};   // POUT values of pins 9 and 10
+     * eqsp32.configCANopenTPDO(1, inputs, 2, 1);           // TPDO1 on every SYNC
+     * eqsp32.configCANopenRPDO(1, outputs, 2);
+     * eqsp32.startCANopen(5);
+     */
+    bool startCANopen(uint8_t nodeID, uint16_t heartbeat_ms = 1000);
+
+    /**
+     * @brief Stops the CANopen slave. The CAN receiver and transmit scheduler keep running.
+     */
+    void stopCANopen();
+
+    /**
+     * @brief Configures the mapping and transmission of a TPDO.
+     *
+     * @param pdo The TPDO number (1 to 4).
+     * @param map The objects to map, packed in order. Their total length must not exceed 64 bits.
+     * @param count The number of mapped objects (0 disables the TPDO, max CANOPEN_MAX_PDO_MAP).
+     * @param transmissionType CANOPEN_PDO_SYNC_ACYCLIC, 1-240 (every n-th SYNC) or CANOPEN_PDO_EVENT. Default is CANOPEN_PDO_EVENT.
+     * @param eventTimer_ms For CANOPEN_PDO_EVENT, the period in milliseconds at which the TPDO is also sent when unchanged. 0 sends on change only.
+     *
+     * @return true if the mapping is valid, false otherwise.
+     */
+    bool configCANopenTPDO(int pdo, const CanOpenPdoMap* map, int count, uint8_t transmissionType = CANOPEN_PDO_EVENT, uint16_t eventTimer_ms = 0);
+
+    /**
+     * @brief Configures the mapping of an RPDO. Received RPDOs are written to the mapped objects while the node is operational.
+     *
+     * @param pdo The RPDO number (1 to 4).
+     * @param map The objects to map, packed in order. Their total length must not exceed 64 bits.
+     * @param count The number of mapped objects (0 disables the RPDO, max CANOPEN_MAX_PDO_MAP).
+     *
+     * @return true if the mapping is valid, false otherwise.
+     */
+    bool configCANopenRPDO(int pdo, const CanOpenPdoMap* map, int count);
+
+    /**
+     * @brief Returns the NMT state of the CANopen slave.
+     */
+    CanOpenNmtState getCANopenState();
+
+    /**
+     * @brief Starts the J1939 layer on the configured CAN bus.
+     *
+     * The J1939 layer claims a source address, answers address claim requests, reassembles multi-packet messages
+     * (BAM broadcasts and RTS/CTS connections addressed to this node) and decodes the SPNs listed in `spns`.
+     * Decoding reads directly from the received frames and reassembly buffers, and each decoded signal is stored
+     * as a typed value together with the update time of its PGN.
+     *
+     * The CAN receiver and transmit scheduler are started if they are not running.
+     *
+     * @param preferredAddress The source address to claim (0 to 253).
+     * @param name The 64-bit J1939 NAME of this node. If the arbitrary address capable bit (bit 63) is set,
+     *          another address in the 128-247 range is claimed when the preferred one is lost.
+     * @param spns The SPN descriptor table. It is copied, so it may be a temporary array.
+     * @param spnCount The number of entries in `spns`.
+     *
+     * @return true if the layer is running, false if the arguments are invalid or the CAN tasks could not be started.
+     *
+     * @attention Call `configCAN(CAN_250K)` (or the bus bit rate) first. J1939 uses 29-bit identifiers.
+     *
+     * @example
+     * Usage example:
+     * const J1939SpnDescriptor spns[] = {
+     *     // pgn      spn    startBit  bitLength  resolution  offset
+     *     {61444,    190,   24,       16,        0.125f,     0},         // EEC1 engine speed (rpm)
+     *     {65262,    110,   0,        8,         1,          -40},       // ET1 engine coolant temperature (C)
+     * };
+     * eqsp32.configCAN(CAN_250K);
+     * eqsp32.startJ1939(0x80, 0x8000000000000000ULL, spns, 2);
+     * ...
+     * float rpm;
+     * if (eqsp32.readJ1939Spn(190, rpm)) Serial.println(rpm);
+     */
+    bool startJ1939(uint8_t preferredAddress, uint64_t name, const J1939SpnDescriptor* spns, int spnCount);
+
+    /**
+     * @brief Stops the J1939 layer. The CAN receiver and transmit scheduler keep running.
+     */
+    void stopJ1939();
+
+    /**
+     * @brief Returns the claimed J1939 source address, or J1939_NULL_ADDRESS if no address could be claimed.
+     */
+    uint8_t getJ1939Address();
+
+    /**
+     * @brief Reads the latest scaled value of a decoded SPN.
+     *
+     * @param spn The SPN, as listed in the descriptor table given to `startJ1939`.
+     * @param value Receives the scaled value.
+     * @param age_ms Optional, receives the time in milliseconds since the SPN's PGN was last received.
+     *
+     * @return true if a valid value is available, false if the SPN is unknown, was never received, or was reported as not available/error.
+     */
+    bool readJ1939Spn(uint32_t spn, float& value, uint32_t* age_ms = nullptr);
+
+    /**
+     * @brief Reads the latest raw value of a decoded SPN.
+     *
+     * @return true if the SPN was received, false if it is unknown or was never received.
+     */
+    bool readJ1939SpnRaw(uint32_t spn, uint32_t& raw);
+
+    /**
+     * @brief Returns the `millis()` time at which a PGN of the descriptor table was last received, 0 if never.
+     */
+    uint32_t getJ1939PgnTimestamp(uint32_t pgn);
+
+    /**
+     * @brief Adds an entry to the CAN to MQTT bridge table. Entries can only be added while the bridge is stopped.
+     *
+     * Each entry maps a CAN ID to a display sensor entity, either with the latest value of a signal of the frame
+     * (CAN_BRIDGE_VALUE) or with the ID's frame rate (CAN_BRIDGE_COUNT). Several entries may use the same CAN ID.
+     *
+     * @param entry The bridge entry. The entity must be created with `createDisplay_Sensor` by the application.
+     *
+     * @return true if the entry was added, false if the bridge is running, the table is full (32 entries) or the entry is invalid.
+     */
+    bool addCANBridgeEntry(const CanBridgeEntry& entry);
+
+    /**
+     * @brief Removes every CAN bridge entry. Has no effect while the bridge is running.
+     */
+    void clearCANBridgeEntries();
+
+    /**
+     * @brief Starts forwarding CAN frames to MQTT display entities.
+     *
+     * The CAN receiver aggregates matching frames as they arrive: value entries keep the latest value, count entries
+     * count frames. Once per publish period, the bridge pushes the entries that changed to their entities in one
+     * batch, and the MQTT device task publishes them. The publish rate is therefore bounded by the period
+     * and the number of entries, whatever the CAN traffic.
+     *
+     * @param publishPeriod_ms The publish period.
+     *
+     * @return true if the bridge is running, false if the table is empty or the tasks could not be started.
+     *
+     * @example
+     * Usage example:
+     * createDisplay_Sensor("Motor speed", 0, "rpm");
+     * CanBridgeEntry speed;
+     * speed.canID = 0x181;
+     * speed.startBit = 16;
+     * speed.bitLength = 16;
+     * speed.entity = "Motor speed";
+     * eqsp32.addCANBridgeEntry(speed);
+     * eqsp32.startCANBridge(500);
+     */
+    bool startCANBridge(uint32_t publishPeriod_ms = 1000);
+
+    /**
+     * @brief Stops the CAN to MQTT bridge. The entries are kept.
+     */
+    void stopCANBridge();
+
+    /**
+     * @brief Returns the CAN bridge frame, publish and latency statistics. The drop rate is `framesCoalesced / framesMatched`.
+     */
+    CanBridgeStats getCANBridgeStats();
+
+    /**
+     * @brief Retrieves heap usage, fragmentation and task stack headroom.
+     *
+     * Internal SRAM and PSRAM are reported separately, with the largest free block and the fragmentation ratio.
+     * A rising fragmentation with a stable free size predicts failing large allocations, such as TLS handshakes,
+     * long before the free size alone does. The stack headroom is reported for the library tasks (system manager,
+     * database, EQConnect, MQTT device, expansion modules and the optional protocol tasks) and `loopTask`.
+     * Task names are reported as FreeRTOS stores them, cut to 15 characters (e.g. "EQSP32_SystemMa").
+     *
+     * @return The memory statistics at the time of the call.
+     *
+     * @example
+     * Usage example:
+     *
+     * @code
+     * MemoryStats mem = eqsp32.getMemoryStats();
+     * ::Serial.printf("Heap %u free, %u largest, %.1f%% fragmented\n", mem.internalFree, mem.internalLargestBlock, mem.internalFragmentation);
+     * for (int i = 0; i < mem.taskCount; i++)
+     *     ::Serial.printf("%s: %u bytes stack left\n", mem.tasks[i].name, mem.tasks[i].stackHeadroom);
+     * @endcode
+     */
+    MemoryStats getMemoryStats();
+
+    /**
+     * @brief Publishes the memory statistics periodically as MQTT diagnostic sensors.
+     *
+     * Creates the display sensors "Heap Free", "Heap Largest Block", "Heap Min Free", "Heap Fragmentation",
+     * "PSRAM Free" (only with PSRAM) and "Min Stack Headroom" (the lowest of all tasks), and updates them from a low
+     * priority task, so fragmentation trends can be alarmed on from the broker.
+     *
+     * @param period_ms Publish period in milliseconds. Default is 60 seconds.
+     * @return true if the diagnostics task was started.
+     */
+    bool startMemoryDiagnostics(uint32_t period_ms = 60000);
+
+    /**
+     * @brief Stops publishing the memory diagnostics. The sensors are kept with their last values.
+     */
+    void stopMemoryDiagnostics();
+
+    /**
+     * @brief Selects where the buffers of a subsystem are allocated.
+     *
+     * Bulk buffers can be moved to PSRAM to leave internal SRAM for the WiFi driver and TLS, while buffers touched on
+     * every frame stay in the faster internal SRAM. The placement applies to the allocations made when the subsystem
+     * is next started. Without PSRAM every placement uses internal SRAM.
+     *
+     * MEMORY_LIBRARY sets the threshold of the ESP-IDF `malloc()` for PSRAM, which is process wide: it applies to the
+     * library core and equally to the sketch, lwIP and any other `malloc()`/`new` user. MEMORY_PREFER_PSRAM sends
+     * requests of 1 KB and more to PSRAM, MEMORY_INTERNAL keeps them all in internal SRAM, and MEMORY_DEFAULT restores
+     * the core's own threshold (CONFIG_SPIRAM_MALLOC_ALWAYSINTERNAL).
+     *
+     * @param subsystem The subsystem to configure.
+     * @param placement MEMORY_INTERNAL, MEMORY_PREFER_PSRAM or MEMORY_DEFAULT.
+     * @return true if the placement was set.
+     *
+     * @example
+     * Usage example:
+     *
+     * @code
+     * eqsp32.configMemoryPlacement(MEMORY_LIBRARY, MEMORY_PREFER_PSRAM);     // JSON and TLS buffers to PSRAM
+     * eqsp32.configMemoryPlacement(MEMORY_SERIAL, MEMORY_PREFER_PSRAM);      // Large serial frames
+     * @endcode
+     */
+    bool configMemoryPlacement(MemorySubsystem subsystem, MemoryPlacement placement);
+
+    /**
+     * @brief Returns how much memory a subsystem currently holds in internal SRAM and in PSRAM.
+     *
+     * MEMORY_LIBRARY allocations are made inside the library core and are not tracked.
+     */
+    MemoryPlacementStats getMemoryPlacementStats(MemorySubsystem subsystem);
+
+    /**
+     * @brief Writes the pending settings of the library services to the non-volatile storage now.
+     *
+     * Settings saved by the library services (e.g. `saveSchedules` and schedule config edits) go through a write-back
+     * cache. Updates equal to the stored value are dropped, and repeated updates are coalesced and written once,
+     * 5 seconds after the last change and at most 60 seconds after the first. This bounds the flash wear caused by
+     * frequent cloud config updates. Pending settings are also written on `esp_restart()`. Call this function before
+     * removing power on purpose, e.g. before deep sleep.
+     */
+    void flushSettings();
+
+    /**
+     * @brief Returns the settings cache update, coalescing and flash write counters.
+     */
+    SettingsCacheStats getSettingsCacheStats();
+
+    /**
+     * @brief Changes the priority of a running library task.
+     *
+     * @param task Task name, e.g. "EQSP32_SystemManager", "EQSP32_MqttDevice" or "EQSP32_CanRx" (see `getMemoryStats` for the list).
+     *          Only the first 15 characters are compared, as FreeRTOS stores no more of a task name.
+     * @param priority New FreeRTOS priority, 1 to configMAX_PRIORITIES - 1.
+     * @return true if the task was found and the priority set.
+     *
+     * @attention Priorities apply until the task is restarted. Lowering the networking tasks can delay cloud updates.
+     * The protocol tasks (CANopen, J1939, Modbus) start at priority 4, below the lwIP thread.
+     */
+    bool configTaskPriority(const std::string& task, int priority);
+
+    /**
+     * @brief Returns the priority of a running library task, or -1 if no task has that name.
+     */
+    int readTaskPriority(const std::string& task);
+
+    /**
+     * @brief Raises the I/O tasks above the networking tasks, so cloud and TLS work cannot preempt pin scanning.
+     *
+     * The system manager and expansion module manager are raised just above the highest of the database, EQConnect
+     * and MQTT device tasks, if they are not already. No task is lowered. Call after `begin()`.
+     *
+     * @return true if the I/O tasks run above the networking tasks.
+     */
+    bool configRealtimeIO();
+
+    // TODO add function description
+    EQ_WifiStatus getWiFiStatus();
+
+    /**
+     * @brief Prints the current local time to the serial output in a human-readable format.
+     * 
+     * This function retrieves the current local time using the configured NTP server or default system time if the NTP is not synchronized. 
+     * If the local time cannot be obtained, it logs an error message. Otherwise, it prints the time in the format:
+     * "Day, Month Date Year Hour:Minute:Second".
+     * 
+     * @note The function uses a timeout to retrieve the local time. If synchronization fails within this time, 
+     *       the function logs an error and exits.
+     * 
+     * @attention Ensure that the NTP server has been successfully configured and the system time is synchronized to get an accurate timestamp.
+     * 
+     * @example
+     * EQSP32 eqsp32;
+     * eqsp32.printLocalTime(); // Prints the current local time or logs an error if unavailable.
+     */
+    void printLocalTime();
+
+    /**
+     * @brief Checks if the local time is synchronized with the NTP server.
+     * 
+     * This function verifies whether the local system time has been synchronized with the NTP server
+     * or if only the default system time is available.
+     * 
+     * @return true if the local time is synchronized with the NTP server, false only default time is available.
+     * 
+     * @attention This function is helpful to determine whether the timestamps used for logging and operations are accurate.
+     * 
+     * @example
+     * EQSP32 eqsp32;
+     * if (eqsp32.isLocalTimeSynced()) {
+     *     // Proceed with time-dependent operations
+     * } else {
+     *     // Handle unsynchronized time
+     * }
+     */
+    bool isLocalTimeSynced();
+
+    /**
+     * @brief Retrieves the current hour from the local time.
+     * 
+     * This function returns the current hour (0-23) based on the local system time. If the local time cannot be 
+     * obtained within the timeout, the function logs an error and returns 0.
+     * 
+     * @return The current local hour (0-23) if successful, 0 otherwise.
+     * 
+     * @attention This function will return the default time if isLocalTimeSynced() is false!
+     * 
+     * @example
+     * EQSP32 eqsp32;
+     * int hour = eqsp32.getLocalHour();
+     * ::Serial.printf("Current Hour: %d\n", hour);
+     * 
+     * @example
+     * // Check synchronization first
+     * EQSP32 eqsp32;
+     * if (eqsp32.isLocalTimeSynced()) {
+     *     int hour = eqsp32.getLocalHour();
+     *     ::Serial.printf("Current Hour: %d\n", hour);
+     * } else {
+     *     ::Serial.println("Local time is not synchronized. Unable to fetch actual local hour.");
+     * }
+     */
+    int getLocalHour();
+
+        /**
+     * @brief Retrieves the current minutes from the local time.
+     * 
+     * This function returns the current minutes (0-59) based on the local system time. If the local time cannot be 
+     * obtained within the timeout, the function logs an error and returns 0.
+     * 
+     * @return The current local minutes (0-59) if successful, 0 otherwise.
+     * 
+     * @attention This function will return the default time if isLocalTimeSynced() is false!
+     * 
+     * @example
+     * EQSP32 eqsp32;
+     * int mins = eqsp32.getLocalMins();
+     * ::Serial.printf("Current Minutes: %d\n", mins);
+     * 
+     * @example
+     * // Check synchronization first
+     * EQSP32 eqsp32;
+     * if (eqsp32.isLocalTimeSynced()) {
+     *     int mins = eqsp32.getLocalMins();
+     *     ::Serial.printf("Current Minutes: %d\n", mins);
+     * } else {
+     *     ::Serial.println("Local time is not synchronized. Unable to fetch actual local minutes.");
+     * }
+     */
+    int getLocalMins();
+
+    long getLocalUnixTimestamp();
+    std::string getFormattedLocalTime();
+    long getUnixTimestamp();
+    std::string getFormattedUnixTimestamp();
+
+    /**
+     * @brief Retrieves all local time fields consistently in one call.
+     *
+     * The broken-down local time is cached and only recalculated when the second changes, so this function
+     * does not wait for the time to become available and is cheap enough to call on every `loop()` iteration.
+     * All fields belong to the same second, unlike separate `getLocalHour()` and `getLocalMins()` calls
+     * which may straddle a minute change. The timezone and DST rules configured for the device are applied.
+     *
+     * @param time Receives the local time.
+     * @return true if the local time is synchronized, false if `time` holds the default time.
+     *
+     * @example
+     * Usage example:
+     *
+     * @code
+     * EQTime now;
+     * if (eqsp32.getLocalTime(now) && now.hour == 6 && now.mins == 30) {
+     *     eqsp32.pinValue(EQ_PIN_1, 1000);
+     * }
+     * @endcode
+     */
+    bool getLocalTime(EQTime& time);
+
+    /**
+     * @brief Adds a cron schedule that drives a pin.
+     *
+     * The schedule format is the standard 5-field cron expression "minute hour day-of-month month day-of-week",
+     * with `*`, lists, ranges and steps, e.g. "0 6,18 * * 1-5" for 06:00 and 18:00 on weekdays. Times are local time,
+     * with the device timezone and DST rules applied: a start inside a skipped DST hour fires when the clock resumes,
+     * and a start inside a repeated hour fires once. When the schedule starts, `pinValue(pin, value)` is set, and after
+     * `duration_s` seconds the pin is set back to 0, unless another active schedule drives the same pin.
+     * With `duration_s` 0 the value is set and left.
+     *
+     * The scheduler computes the next start of each schedule once, when the schedule changes or fires, and runs in its
+     * own task, so `loop()` does not need to compare times. Schedules do not start while `isLocalTimeSynced()` is false.
+     * Once the time is synced, a window that is already in progress is entered for its remaining time, so a device
+     * that reboots in the middle of an irrigation window resumes it.
+     *
+     * @param cron Cron expression.
+     * @param duration_s Window length in seconds, up to 7 days.
+     * @param pin The pin driven by the schedule.
+     * @param value The value the pin is set to while the schedule is active. Default is 1000.
+     * @return The schedule ID, or -1 if the expression is invalid, matches no date (e.g. "0 0 30 2 *") or too many schedules exist.
+     *
+     * @example
+     * Usage example:
+     *
+     * @code
+     * eqsp32.addSchedule("30 6 * * *", 20 * 60, EQ_PIN_3);    // Irrigation valve on every day at 06:30 for 20 minutes
+     * @endcode
+     */
+    int addSchedule(const std::string& cron, uint32_t duration_s, int pin, int value = 1000);
+
+    /**
+     * @brief Adds a cron schedule that calls a function at the start and end of each window.
+     *
+     * See `addSchedule(cron, duration_s, pin, value)` for the schedule format and behavior.
+     * With `duration_s` 0 the callback is only called with `active` true.
+     *
+     * @return The schedule ID, or -1 if the expression is invalid, matches no date (e.g. "0 0 30 2 *") or too many schedules exist.
+     */
+    int addSchedule(const std::string& cron, uint32_t duration_s, EQScheduleCallback callback, void* arg = nullptr);
+
+    /**
+     * @brief Adds a weekly schedule that drives a pin.
+     *
+     * @param days Days of the week the schedule starts on, SCHEDULE_* masks combined with `|`.
+     * @param hour Start hour (0-23).
+     * @param mins Start minutes (0-59).
+     * @param duration_s Window length in seconds, up to 7 days.
+     * @param pin The pin driven by the schedule.
+     * @param value The value the pin is set to while the schedule is active. Default is 1000.
+     * @return The schedule ID, or -1 on invalid parameters.
+     *
+     * @example
+     * Usage example:
+     *
+     * @code
+     * eqsp32.addWeeklySchedule(SCHEDULE_WEEKDAYS, 7, 0, 10 * 3600, EQ_PIN_1);  // Heating on weekdays 07:00-17:00
+     * @endcode
+     */
+    int addWeeklySchedule(uint8_t days, int hour, int mins, uint32_t duration_s, int pin, int value = 1000);
+
+    /**
+     * @brief Removes a schedule. A pin driven by an active schedule is set to 0.
+     */
+    bool removeSchedule(int id);
+
+    /**
+     * @brief Removes all schedules.
+     */
+    void clearSchedules();
+
+    /**
+     * @brief Enables or disables a schedule. Disabling an active schedule ends its window. Schedules are enabled when added.
+     */
+    bool enableSchedule(int id, bool enable);
+
+    /**
+     * @brief Retrieves whether a schedule is active and when it starts next.
+     */
+    bool getScheduleStatus(int id, EQScheduleStatus& status);
+
+    /**
+     * @brief Saves the timing (days, times, duration, enabled) of all schedules to the non-volatile storage.
+     *
+     * Schedule targets are not saved: a sketch adds its schedules in `setup()` and then calls `loadSchedules()`
+     * to restore the timing changed at runtime, e.g. through `linkScheduleConfig`. Schedules are matched by ID,
+     * so they must be added in the same order.
+     *
+     * @attention The flash write is deferred by the settings cache, see `flushSettings()`.
+     */
+    bool saveSchedules();
+
+    /**
+     * @brief Restores the schedule timing saved by `saveSchedules()` onto the existing schedules with the same IDs.
+     *
+     * @return true if saved timing was found and applied.
+     */
+    bool loadSchedules();
+
+    /**
+     * @brief Exposes a weekly schedule as config entities, so it can be edited from the EQ IoT app.
+     *
+     * Creates "<name> Start" (HHMM), "<name> Duration" (minutes), "<name> Days" (SCHEDULE_* mask) and "<name> Enable".
+     * Edits are applied by the scheduler task within a second and saved to the non-volatile storage.
+     * Editing turns a cron schedule into a weekly schedule. Invalid edits (e.g. no day selected or a start of 2399) are
+     * rejected and the entities are set back to the schedule in use.
+     *
+     * @return true if the entities were created.
+     */
+    bool linkScheduleConfig(int id, const std::string& name);
+
+private:
+    class EQ_Private;       // Forward declaration of the nested private class
+    EQ_Private* eqPrivate;
+};
+
+
+/**
+ * @brief EQTimer class for managing timing operations.
+ * 
+ * The EQTimer class provides methods to start, stop, pause, reset, and check the status of a timer.
+ * It is useful for timing events and managing delays in the EQSP32 application.
+ */
+class EQTimer {
+public:
+    /**
+     * @brief Constructs a EQTimer object with an optional preset value.
+     * 
+     * Initializes a EQTimer object, setting an optional preset value for the timer.
+     * The timer is initially stopped.
+     * 
+     * @param preset Optional preset value in milliseconds for the timer. Default is 0.
+     * 
+     * @example
+     * Usage example:
+     * 
+     * @code
+     * EQTimer myTimer(5000); // Creates a EQTimer object with a 5 second preset
+     * @endcode
+     */
+    EQTimer(unsigned long preset = 0);
+
+    /**
+     * @brief Starts the timer with an optional preset value.
+     * 
+     * Starts the timer if it is not already running.
      * If a preset value is provided, it updates the timer's preset value.
      * 
      * @param preset Optional preset value in milliseconds. Default is 0.
@@ -1060,6 +2293,102 @@ private:
 };
 
 
+class EQWheelTimer;
+typedef void (*EQTimerCallback)(EQWheelTimer& timer, void* arg);
+
+/**
+ * @brief EQWheelTimer class, an EQTimer driven by a shared timer wheel.
+ *
+ * EQWheelTimer has the same interface and behavior as EQTimer, so existing code can switch by changing the type.
+ * Running timers are kept in a hierarchical timer wheel serviced by one background task every millisecond.
+ * The expiry flag is set and the optional callback called by the wheel, so `isExpired()` is a flag read and
+ * an application does not pay a per-timer polling cost, whatever the number of timers. Start, stop and pause are O(1).
+ * Time is kept in 64-bit milliseconds, so timers are not affected by the `millis()` rollover.
+ *
+ * @attention Callbacks run in the timer wheel task, at priority 2 (see `configTaskPriority`). They must be short and
+ *          must not block. Destroying a timer stops it; if its callback is running in the wheel task at that moment,
+ *          the destructor waits for the callback to return, so the memory the callback uses (e.g. `arg`) must
+ *          remain valid until then.
+ *
+ * @example
+ * Usage example:
+ *
+ * @code
+ * void onValveTimeout(EQWheelTimer& timer, void* arg) {
+ *     eqsp32.pinValue(EQ_PIN_9, 0);
+ * }
+ *
+ * EQWheelTimer valveTimer(30000, onValveTimeout);
+ * ...
+ * eqsp32.pinValue(EQ_PIN_9, 1000);
+ * valveTimer.start();          // The valve closes after 30 seconds, without polling in loop()
+ * @endcode
+ */
+class EQWheelTimer {
+public:
+    /**
+     * @brief Constructs a stopped timer.
+     *
+     * @param preset Optional preset value in milliseconds.
+     * @param callback Optional function called by the timer wheel when the timer expires.
+     * @param arg Argument passed to the callback.
+     * @param periodic If true, the callback is called every `preset` milliseconds while the timer runs.
+     */
+    EQWheelTimer(unsigned long preset = 0, EQTimerCallback callback = nullptr, void* arg = nullptr, bool periodic = false);
+    ~EQWheelTimer();
+
+    /**
+     * @brief Starts or resumes the timer, see `EQTimer::start`.
+     */
+    bool start(unsigned long preset = 0);
+
+    /**
+     * @brief Stops the timer and resets the elapsed time, see `EQTimer::stop`.
+     */
+    void stop();
+
+    /**
+     * @brief Pauses the timer, retaining the elapsed time, see `EQTimer::pause`.
+     */
+    void pause();
+
+    /**
+     * @brief Stops the timer and resets the elapsed time, optionally updating the preset, see `EQTimer::reset`.
+     */
+    bool reset(unsigned long preset = 0);
+
+    /**
+     * @brief Returns the elapsed time in milliseconds, see `EQTimer::value`.
+     */
+    unsigned long value();
+
+    /**
+     * @brief Returns true once the timer has reached its preset, see `EQTimer::isExpired`.
+     */
+    bool isExpired();
+
+    /**
+     * @brief Returns true while the timer is running, see `EQTimer::isRunning`.
+     */
+    bool isRunning();
+
+private:
+    friend class EQTimerWheel;
+
+    EQWheelTimer* next = nullptr;       // Timer wheel slot list
+    EQWheelTimer** pprev = nullptr;     // Previous `next` or slot head, nullptr when not in the wheel
+    uint64_t expiry_ms = 0;
+    uint64_t start_ms = 0;
+    uint64_t elapsed_ms = 0;            // Accumulated before the last pause
+    unsigned long presetValue;
+    EQTimerCallback callback;
+    void* callbackArg;
+    bool periodic;
+    bool running = false;
+    volatile bool expired = false;
+};
+
+
 /*  ***********************************************
      ---   ---   ---   ---   ---   ---   ---   ---
     MQTT Device Interfacing Entities    (Beta EQ IoT app)
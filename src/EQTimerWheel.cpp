@@ -0,0 +1,320 @@
+#include "EQSP32.h"
+
+#include <atomic>
+
+#define TIMER_WHEEL_TASK_STACK      4096
+#define TIMER_WHEEL_TASK_PRIORITY   2       // Runs user callbacks, below lwIP and the I/O tasks
+#define TIMER_WHEEL_LEVELS          4
+#define TIMER_WHEEL_SLOT_BITS       6
+#define TIMER_WHEEL_SLOTS           (1 << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_SLOT_MASK       (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_RANGE_MS        (1ULL << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOT_BITS))     // ~4.6 hours, longer timers are re-cascaded
+
+
+/*  ***********************************************
+     ---   ---   ---   ---   ---   ---   ---   ---
+    Hierarchical timer wheel
+     ---   ---   ---   ---   ---   ---   ---   ---
+    ***********************************************   */
+static EQWheelTimer* wheelSlots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+static uint64_t wheelNow_ms = 0;            // Last processed tick
+static EQWheelTimer* wheelCallbackTimer = nullptr;      // Timer whose callback is running
+static TaskHandle_t wheelTaskHandle = NULL;
+
+// A mutex, not a spinlock: cascades relink every timer of a slot, which must not run with interrupts masked
+static SemaphoreHandle_t wheelMutex = NULL;
+static std::atomic<int> wheelState(0);      // 0: not started, 1: starting, 2: ready
+
+static void wheelLock()
+{
+    xSemaphoreTake(wheelMutex, portMAX_DELAY);
+}
+
+static void wheelUnlock()
+{
+    xSemaphoreGive(wheelMutex);
+}
+
+static uint64_t wheelClock_ms()
+{
+    return esp_timer_get_time() / 1000;
+}
+
+class EQTimerWheel
+{
+public:
+    // Links the timer in the slot of its expiry time, no earlier than `earliest`. Must be called with wheelMutex held.
+    static void insert(EQWheelTimer* timer, uint64_t earliest)
+    {
+        uint64_t expiry = timer->expiry_ms < earliest ? earliest : timer->expiry_ms;
+        if (expiry - wheelNow_ms >= TIMER_WHEEL_RANGE_MS)
+            expiry = wheelNow_ms + TIMER_WHEEL_RANGE_MS - 1;     // Parked in the last level, re-inserted when cascaded
+
+        uint64_t delta = expiry - wheelNow_ms;
+        int level = 0;
+        while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1ULL << ((level + 1) * TIMER_WHEEL_SLOT_BITS)))
+            level++;
+
+        EQWheelTimer** slot = &wheelSlots[level][(expiry >> (level * TIMER_WHEEL_SLOT_BITS)) & TIMER_WHEEL_SLOT_MASK];
+        timer->next = *slot;
+        if (*slot != nullptr)
+            (*slot)->pprev = &timer->next;
+        *slot = timer;
+        timer->pprev = slot;
+    }
+
+    // Must be called with wheelMutex held
+    static void unlink(EQWheelTimer* timer)
+    {
+        if (timer->pprev == nullptr)
+            return;
+
+        *timer->pprev = timer->next;
+        if (timer->next != nullptr)
+            timer->next->pprev = timer->pprev;
+        timer->next = nullptr;
+        timer->pprev = nullptr;
+    }
+
+    // Arms a running timer from its start time and accumulated time. Must be called with wheelMutex held.
+    static void schedule(EQWheelTimer* timer)
+    {
+        if (timer->presetValue == 0 || (!timer->periodic && timer->elapsed_ms >= timer->presetValue))
+        {
+            timer->expired = true;
+            return;
+        }
+        if (!timer->periodic)
+            timer->expired = false;
+        timer->expiry_ms = timer->start_ms + timer->presetValue - timer->elapsed_ms % timer->presetValue;
+        insert(timer, wheelNow_ms + 1);
+    }
+
+    static void cascade(int level)
+    {
+        int index = (wheelNow_ms >> (level * TIMER_WHEEL_SLOT_BITS)) & TIMER_WHEEL_SLOT_MASK;
+        EQWheelTimer* timer = wheelSlots[level][index];
+        wheelSlots[level][index] = nullptr;
+
+        while (timer != nullptr)
+        {
+            EQWheelTimer* next = timer->next;
+            insert(timer, wheelNow_ms);     // Timers due now land in the level 0 slot processed next
+            timer = next;
+        }
+    }
+
+    static void tick()
+    {
+        wheelLock();
+        wheelNow_ms++;
+        for (int level = 1; level < TIMER_WHEEL_LEVELS; level++)
+        {
+            if (wheelNow_ms & ((1ULL << (level * TIMER_WHEEL_SLOT_BITS)) - 1))
+                break;
+            cascade(level);
+        }
+
+        // Expire one timer at a time, callbacks run outside the lock and may start or stop any timer
+        EQWheelTimer** slot = &wheelSlots[0][wheelNow_ms & TIMER_WHEEL_SLOT_MASK];
+        while (*slot != nullptr)
+        {
+            EQWheelTimer* timer = *slot;
+            unlink(timer);
+
+            if (timer->expiry_ms > wheelNow_ms)
+            {
+                insert(timer, wheelNow_ms + 1);     // Parked timer, not due yet
+                continue;
+            }
+
+            timer->expired = true;
+            if (timer->periodic)
+            {
+                timer->expiry_ms += timer->presetValue;
+                insert(timer, wheelNow_ms + 1);
+            }
+            EQTimerCallback callback = timer->callback;
+            void* arg = timer->callbackArg;
+            if (callback == nullptr)
+                continue;
+
+            wheelCallbackTimer = timer;
+            wheelUnlock();
+            callback(*timer, arg);
+            wheelLock();
+            wheelCallbackTimer = nullptr;
+        }
+        wheelUnlock();
+    }
+};
+
+static void timerWheelTask(void* arg)
+{
+    TickType_t lastWake = xTaskGetTickCount();
+
+    while (true)
+    {
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(1) > 0 ? pdMS_TO_TICKS(1) : 1);
+
+        // Catch up on every elapsed millisecond, so expiry does not depend on the task being scheduled on time
+        uint64_t now_ms = wheelClock_ms();
+        while (wheelNow_ms < now_ms)
+            EQTimerWheel::tick();
+    }
+}
+
+static bool timerWheelStart()
+{
+    int state = 0;
+    if (wheelState.compare_exchange_strong(state, 1))
+    {
+        wheelNow_ms = wheelClock_ms();
+        wheelMutex = xSemaphoreCreateMutex();
+        if (wheelMutex == NULL ||
+            xTaskCreatePinnedToCore(timerWheelTask, "EQSP32_TmrWheel", TIMER_WHEEL_TASK_STACK, NULL,
+                                    TIMER_WHEEL_TASK_PRIORITY, &wheelTaskHandle, tskNO_AFFINITY) != pdPASS)
+        {
+            if (wheelMutex != NULL)
+                vSemaphoreDelete(wheelMutex);
+            wheelMutex = NULL;
+            wheelState.store(0);
+            return false;
+        }
+        wheelState.store(2);
+    }
+
+    while (wheelState.load() == 1)
+        vTaskDelay(1);
+    return wheelState.load() == 2;
+}
+
+
+/*  ***********************************************
+     ---   ---   ---   ---   ---   ---   ---   ---
+    EQWheelTimer
+     ---   ---   ---   ---   ---   ---   ---   ---
+    ***********************************************   */
+EQWheelTimer::EQWheelTimer(unsigned long preset, EQTimerCallback callback, void* arg, bool periodic)
+    : presetValue(preset), callback(callback), callbackArg(arg), periodic(periodic)
+{
+}
+
+EQWheelTimer::~EQWheelTimer()
+{
+    if (wheelState.load() != 2)
+        return;             // Never started, not linked
+
+    // Also wait for a callback of this timer running in the wheel task
+    wheelLock();
+    EQTimerWheel::unlink(this);
+    running = false;
+    while (wheelCallbackTimer == this && xTaskGetCurrentTaskHandle() != wheelTaskHandle)
+    {
+        wheelUnlock();
+        vTaskDelay(1);
+        wheelLock();
+        EQTimerWheel::unlink(this);         // Re-armed by its callback
+    }
+    wheelUnlock();
+}
+
+bool EQWheelTimer::start(unsigned long preset)
+{
+    if (!timerWheelStart())
+        return false;
+
+    wheelLock();
+    if (running)
+    {
+        wheelUnlock();
+        return false;
+    }
+
+    if (preset != 0)
+        presetValue = preset;
+    start_ms = wheelClock_ms();
+    running = true;
+    EQTimerWheel::schedule(this);
+    wheelUnlock();
+
+    return true;
+}
+
+void EQWheelTimer::stop()
+{
+    if (wheelState.load() != 2)
+    {
+        expired = false;
+        elapsed_ms = 0;
+        return;
+    }
+
+    wheelLock();
+    EQTimerWheel::unlink(this);
+    running = false;
+    expired = false;
+    elapsed_ms = 0;
+    wheelUnlock();
+}
+
+void EQWheelTimer::pause()
+{
+    if (wheelState.load() != 2)
+        return;             // Never started, cannot be running
+
+    wheelLock();
+    if (running)
+    {
+        EQTimerWheel::unlink(this);
+        elapsed_ms += wheelClock_ms() - start_ms;
+        running = false;
+    }
+    wheelUnlock();
+}
+
+bool EQWheelTimer::reset(unsigned long preset)
+{
+    if (wheelState.load() != 2)
+    {
+        expired = false;
+        elapsed_ms = 0;
+        if (preset != 0)
+            presetValue = preset;
+        return false;
+    }
+
+    wheelLock();
+    bool wasRunning = running;
+    EQTimerWheel::unlink(this);
+    running = false;
+    expired = false;
+    elapsed_ms = 0;
+    if (preset != 0)
+        presetValue = preset;
+    wheelUnlock();
+
+    return wasRunning;
+}
+
+unsigned long EQWheelTimer::value()
+{
+    if (wheelState.load() != 2)
+        return (unsigned long)elapsed_ms;
+
+    wheelLock();
+    uint64_t value = running ? elapsed_ms + wheelClock_ms() - start_ms : elapsed_ms;
+    wheelUnlock();
+
+    return (unsigned long)value;
+}
+
+bool EQWheelTimer::isExpired()
+{
+    return expired;
+}
+
+bool EQWheelTimer::isRunning()
+{
+    return running;
+}
@@ -0,0 +1,565 @@
+#include "CAN_Handling.h"
+#include "Memory_Handling.h"
+#include "Task_Handling.h"
+
+#include <algorithm>
+#include <atomic>
+
+#define J1939_TASK_STACK        4096
+#define J1939_TASK_PRIORITY     TASK_PRIORITY_PROTOCOL
+#define J1939_TICK_MS           50      // Transport session timeout resolution
+#define J1939_RX_QUEUE_SIZE     64
+
+#define J1939_TP_SESSIONS       4       // Concurrent BAM and RTS/CTS reassemblies
+#define J1939_TP_MAX_SIZE       1785    // 255 packets * 7 bytes
+#define J1939_TP_TIMEOUT_MS     750     // T1, max gap between data packets
+
+#define J1939_PGN_REQUEST       0xEA00
+#define J1939_PGN_ADDRESS_CLAIM 0xEE00
+#define J1939_PGN_TP_CM         0xEC00
+#define J1939_PGN_TP_DT         0xEB00
+
+#define J1939_TP_RTS            16
+#define J1939_TP_CTS            17
+#define J1939_TP_EOMA           19
+#define J1939_TP_BAM            32
+#define J1939_TP_ABORT          255
+
+#define J1939_ABORT_RESOURCES   2
+#define J1939_ABORT_TIMEOUT     3
+
+#define J1939_PRIORITY_DEFAULT  6
+#define J1939_ARBITRARY_ADDRESS (1ULL << 63)
+
+
+/*  ***********************************************
+     ---   ---   ---   ---   ---   ---   ---   ---
+    J1939 PGN/SPN decode table
+     ---   ---   ---   ---   ---   ---   ---   ---
+    ***********************************************   */
+typedef struct {
+    J1939SpnDescriptor desc;
+    uint32_t raw;
+    bool received;
+} J1939Spn;
+
+typedef struct {
+    uint32_t pgn;
+    uint16_t firstSpn;          // Index of the PGN's first entry in j1939Spns
+    uint16_t spnCount;
+    uint32_t timestamp;         // millis() of the last update, 0 if never received
+} J1939Pgn;
+
+static J1939Spn* j1939Spns = nullptr;           // Sorted by PGN
+static uint16_t* j1939SpnIndex = nullptr;       // j1939Spns indexes sorted by SPN
+static int j1939SpnCount = 0;
+static J1939Pgn* j1939Pgns = nullptr;           // Sorted by PGN
+static int j1939PgnCount = 0;
+static portMUX_TYPE j1939Mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void j1939FreeTable()
+{
+    portENTER_CRITICAL(&j1939Mux);
+    j1939SpnCount = 0;
+    j1939PgnCount = 0;
+    portEXIT_CRITICAL(&j1939Mux);
+
+    memoryFree(j1939Spns);
+    memoryFree(j1939SpnIndex);
+    memoryFree(j1939Pgns);
+    j1939Spns = nullptr;
+    j1939SpnIndex = nullptr;
+    j1939Pgns = nullptr;
+}
+
+static bool j1939BuildTable(const J1939SpnDescriptor* spns, int spnCount)
+{
+    j1939FreeTable();
+
+    j1939Spns = (J1939Spn*)memoryAlloc(MEMORY_J1939, spnCount * sizeof(J1939Spn));
+    j1939SpnIndex = (uint16_t*)memoryAlloc(MEMORY_J1939, spnCount * sizeof(uint16_t));
+    j1939Pgns = (J1939Pgn*)memoryAlloc(MEMORY_J1939, spnCount * sizeof(J1939Pgn));
+    if (j1939Spns == nullptr || j1939SpnIndex == nullptr || j1939Pgns == nullptr)
+    {
+        j1939FreeTable();
+        return false;
+    }
+
+    for (int i = 0; i < spnCount; i++)
+        j1939Spns[i] = {spns[i], 0, false};
+    std::stable_sort(j1939Spns, j1939Spns + spnCount,
+                     [](const J1939Spn& a, const J1939Spn& b) { return a.desc.pgn < b.desc.pgn; });
+
+    int pgnCount = 0;
+    for (int i = 0; i < spnCount; i++)
+    {
+        j1939SpnIndex[i] = i;
+        if (pgnCount == 0 || j1939Pgns[pgnCount - 1].pgn != j1939Spns[i].desc.pgn)
+            j1939Pgns[pgnCount++] = {j1939Spns[i].desc.pgn, (uint16_t)i, 0, 0};
+        j1939Pgns[pgnCount - 1].spnCount++;
+    }
+    std::sort(j1939SpnIndex, j1939SpnIndex + spnCount,
+              [](uint16_t a, uint16_t b) { return j1939Spns[a].desc.spn < j1939Spns[b].desc.spn; });
+
+    portENTER_CRITICAL(&j1939Mux);
+    j1939PgnCount = pgnCount;
+    j1939SpnCount = spnCount;
+    portEXIT_CRITICAL(&j1939Mux);
+    return true;
+}
+
+static J1939Pgn* j1939FindPgn(uint32_t pgn)
+{
+    J1939Pgn* end = j1939Pgns + j1939PgnCount;
+    J1939Pgn* it = std::lower_bound(j1939Pgns, end, pgn, [](const J1939Pgn& p, uint32_t v) { return p.pgn < v; });
+    return (it != end && it->pgn == pgn) ? it : nullptr;
+}
+
+static J1939Spn* j1939FindSpn(uint32_t spn)
+{
+    uint16_t* end = j1939SpnIndex + j1939SpnCount;
+    uint16_t* it = std::lower_bound(j1939SpnIndex, end, spn, [](uint16_t i, uint32_t v) { return j1939Spns[i].desc.spn < v; });
+    return (it != end && j1939Spns[*it].desc.spn == spn) ? &j1939Spns[*it] : nullptr;
+}
+
+// Decodes straight from the frame or reassembly buffer, no intermediate copy of the PGN data
+static void j1939Decode(uint32_t pgn, const uint8_t* data, size_t length)
+{
+    J1939Pgn* entry = j1939FindPgn(pgn);
+    if (entry == nullptr)
+        return;
+
+    uint32_t now = millis();
+
+    portENTER_CRITICAL(&j1939Mux);
+    for (int i = entry->firstSpn; i < entry->firstSpn + entry->spnCount; i++)
+    {
+        J1939Spn& spn = j1939Spns[i];
+        uint32_t firstByte = spn.desc.startBit / 8;
+        uint32_t lastByte = (spn.desc.startBit + spn.desc.bitLength - 1) / 8;
+        if (spn.desc.bitLength == 0 || spn.desc.bitLength > 32 || lastByte >= length)
+            continue;
+
+        uint64_t bits = 0;
+        for (uint32_t b = lastByte + 1; b-- > firstByte;)
+            bits = (bits << 8) | data[b];
+        bits >>= spn.desc.startBit % 8;
+
+        spn.raw = (uint32_t)(bits & (0xFFFFFFFFULL >> (32 - spn.desc.bitLength)));
+        spn.received = true;
+    }
+    entry->timestamp = now != 0 ? now : 1;
+    portEXIT_CRITICAL(&j1939Mux);
+}
+
+
+/*  ***********************************************
+     ---   ---   ---   ---   ---   ---   ---   ---
+    J1939 network management and transport protocol
+     ---   ---   ---   ---   ---   ---   ---   ---
+    ***********************************************   */
+typedef struct {
+    bool active;
+    bool bam;
+    uint8_t source;
+    uint32_t pgn;
+    uint16_t size;
+    uint8_t packets;
+    uint8_t nextSeq;
+    uint8_t ctsEnd;             // Last sequence number of the current CTS window
+    uint8_t maxPerCts;
+    int64_t lastActivity_us;
+    uint8_t* data;              // J1939_TP_MAX_SIZE bytes of j1939TpBuffer
+} J1939TpSession;
+
+static J1939TpSession j1939Sessions[J1939_TP_SESSIONS];
+static uint8_t* j1939TpBuffer = nullptr;        // Reassembly buffers of all sessions, kept across restarts
+static uint64_t j1939Name = 0;
+static uint8_t j1939PreferredAddress = J1939_NULL_ADDRESS;
+static std::atomic<uint8_t> j1939Address(J1939_NULL_ADDRESS);
+static uint32_t j1939ClaimedByOthers[8];        // Bitset of addresses claimed by other nodes
+
+static std::atomic<bool> j1939Running(false);
+static QueueHandle_t j1939RxQueue = NULL;
+static TaskHandle_t j1939TaskHandle = NULL;
+
+static uint32_t j1939Id(uint8_t priority, uint32_t pgn, uint8_t destination, uint8_t source)
+{
+    if (((pgn >> 8) & 0xFF) < 240)      // PDU1, destination specific
+        pgn = (pgn & 0x3FF00) | destination;
+    return ((uint32_t)priority << 26) | (pgn << 8) | source;
+}
+
+static void j1939Send(uint32_t pgn, uint8_t destination, const uint8_t* data, uint8_t length, uint8_t source)
+{
+    CanMessage msg = {};
+    msg.extd = 1;
+    msg.identifier = j1939Id(J1939_PRIORITY_DEFAULT, pgn, destination, source);
+    msg.data_length_code = length;
+    memcpy(msg.data, data, length);
+    canQueueFrame(msg, pgn == J1939_PGN_ADDRESS_CLAIM ? CAN_TX_HIGH : CAN_TX_NORMAL);
+}
+
+static void j1939SendAddressClaim()
+{
+    uint8_t name[8];
+    for (int b = 0; b < 8; b++)
+        name[b] = (uint8_t)(j1939Name >> (8 * b));
+    j1939Send(J1939_PGN_ADDRESS_CLAIM, J1939_GLOBAL_ADDRESS, name, 8, j1939Address.load());
+}
+
+static void j1939SendTpCm(uint8_t destination, uint8_t control, uint8_t b1, uint8_t b2, uint8_t b3, uint8_t b4, uint32_t pgn)
+{
+    uint8_t data[8] = {control, b1, b2, b3, b4, (uint8_t)pgn, (uint8_t)(pgn >> 8), (uint8_t)(pgn >> 16)};
+    j1939Send(J1939_PGN_TP_CM, destination, data, 8, j1939Address.load());
+}
+
+static bool j1939IsClaimedByOther(uint8_t address)
+{
+    return j1939ClaimedByOthers[address / 32] & (1u << (address % 32));
+}
+
+static void j1939ProcessAddressClaim(uint8_t source, const CanMessage& msg)
+{
+    if (msg.data_length_code < 8)
+        return;
+
+    uint64_t name = 0;
+    for (int b = 7; b >= 0; b--)
+        name = (name << 8) | msg.data[b];
+
+    if (source < J1939_NULL_ADDRESS)
+        j1939ClaimedByOthers[source / 32] |= 1u << (source % 32);
+
+    uint8_t address = j1939Address.load();
+    if (source != address || name == j1939Name)
+        return;
+
+    if (j1939Name < name)       // Lower NAME has priority, defend the address
+    {
+        j1939SendAddressClaim();
+        return;
+    }
+
+    // Address lost, look for a free one if we are allowed to
+    uint8_t next = J1939_NULL_ADDRESS;
+    if (j1939Name & J1939_ARBITRARY_ADDRESS)
+    {
+        for (int a = 128; a <= 247; a++)
+        {
+            if (a != address && !j1939IsClaimedByOther(a))
+            {
+                next = a;
+                break;
+            }
+        }
+    }
+    j1939Address.store(next);
+    j1939SendAddressClaim();        // From the null address this is a cannot claim message
+}
+
+static J1939TpSession* j1939FindSession(uint8_t source, bool bam)
+{
+    for (int i = 0; i < J1939_TP_SESSIONS; i++)
+        if (j1939Sessions[i].active && j1939Sessions[i].source == source && j1939Sessions[i].bam == bam)
+            return &j1939Sessions[i];
+    return nullptr;
+}
+
+static void j1939SendCts(J1939TpSession& session)
+{
+    uint8_t remaining = session.packets - session.nextSeq + 1;
+    uint8_t count = remaining < session.maxPerCts ? remaining : session.maxPerCts;
+    session.ctsEnd = session.nextSeq + count - 1;
+    j1939SendTpCm(session.source, J1939_TP_CTS, count, session.nextSeq, 0xFF, 0xFF, session.pgn);
+}
+
+static void j1939ProcessTpCm(uint8_t source, uint8_t destination, const CanMessage& msg, int64_t now_us)
+{
+    if (msg.data_length_code < 8)
+        return;
+
+    uint8_t control = msg.data[0];
+    uint16_t size = msg.data[1] | (msg.data[2] << 8);
+    uint8_t packets = msg.data[3];
+    uint32_t pgn = msg.data[5] | (msg.data[6] << 8) | ((uint32_t)msg.data[7] << 16);
+    bool bam = control == J1939_TP_BAM;
+
+    if (control == J1939_TP_ABORT)
+    {
+        J1939TpSession* session = j1939FindSession(source, false);
+        if (session != nullptr)
+            session->active = false;
+        return;
+    }
+    if (control != J1939_TP_BAM && control != J1939_TP_RTS)
+        return;
+    if (!bam && destination != j1939Address.load())
+        return;
+
+    // A new announcement from the same source replaces any unfinished session
+    J1939TpSession* session = j1939FindSession(source, bam);
+    if (session == nullptr)
+        for (int i = 0; i < J1939_TP_SESSIONS && session == nullptr; i++)
+            if (!j1939Sessions[i].active)
+                session = &j1939Sessions[i];
+
+    bool wanted = j1939FindPgn(pgn) != nullptr && size <= J1939_TP_MAX_SIZE && packets > 0 && (size + 6) / 7 == packets;
+    if (session == nullptr || !wanted)
+    {
+        if (!bam)
+            j1939SendTpCm(source, J1939_TP_ABORT, J1939_ABORT_RESOURCES, 0xFF, 0xFF, 0xFF, pgn);
+        return;
+    }
+
+    session->active = true;
+    session->bam = bam;
+    session->source = source;
+    session->pgn = pgn;
+    session->size = size;
+    session->packets = packets;
+    session->nextSeq = 1;
+    session->maxPerCts = (bam || msg.data[4] == 0) ? 0xFF : msg.data[4];
+    session->lastActivity_us = now_us;
+
+    if (!bam)
+        j1939SendCts(*session);
+}
+
+static void j1939ProcessTpDt(uint8_t source, uint8_t destination, const CanMessage& msg, int64_t now_us)
+{
+    if (msg.data_length_code < 8)
+        return;
+
+    J1939TpSession* session = j1939FindSession(source, destination == J1939_GLOBAL_ADDRESS);
+    if (session == nullptr || msg.data[0] != session->nextSeq)
+        return;             // Unexpected or out of order packet, the session times out
+
+    size_t offset = (size_t)(session->nextSeq - 1) * 7;
+    size_t bytes = session->size - offset < 7 ? session->size - offset : 7;
+    memcpy(&session->data[offset], &msg.data[1], bytes);
+    session->lastActivity_us = now_us;
+
+    if (session->nextSeq == session->packets)
+    {
+        session->active = false;
+        j1939Decode(session->pgn, session->data, session->size);
+        if (!session->bam)
+            j1939SendTpCm(source, J1939_TP_EOMA, (uint8_t)session->size, (uint8_t)(session->size >> 8), session->packets, 0xFF, session->pgn);
+        return;
+    }
+
+    if (!session->bam && session->nextSeq == session->ctsEnd)
+    {
+        session->nextSeq++;
+        j1939SendCts(*session);
+        return;
+    }
+    session->nextSeq++;
+}
+
+static void j1939ProcessFrame(const CanMessage& msg, int64_t now_us)
+{
+    uint32_t id = msg.identifier;
+    uint8_t pf = (id >> 16) & 0xFF;
+    uint8_t ps = (id >> 8) & 0xFF;
+    uint8_t source = id & 0xFF;
+    uint32_t pgn = ((id >> 8) & 0x30000) | ((uint32_t)pf << 8) | (pf >= 240 ? ps : 0);
+    uint8_t destination = pf < 240 ? ps : J1939_GLOBAL_ADDRESS;
+    uint8_t address = j1939Address.load();
+
+    if (destination != J1939_GLOBAL_ADDRESS && destination != address)
+        return;
+
+    switch (pgn)
+    {
+        case J1939_PGN_ADDRESS_CLAIM:
+            j1939ProcessAddressClaim(source, msg);
+            break;
+        case J1939_PGN_REQUEST:
+            if (msg.data_length_code >= 3 && (msg.data[0] | (msg.data[1] << 8) | ((uint32_t)msg.data[2] << 16)) == J1939_PGN_ADDRESS_CLAIM)
+                j1939SendAddressClaim();
+            break;
+        case J1939_PGN_TP_CM:
+            j1939ProcessTpCm(source, destination, msg, now_us);
+            break;
+        case J1939_PGN_TP_DT:
+            j1939ProcessTpDt(source, destination, msg, now_us);
+            break;
+        default:
+            j1939Decode(pgn, msg.data, msg.data_length_code);
+            break;
+    }
+}
+
+static void j1939CheckTimeouts(int64_t now_us)
+{
+    for (int i = 0; i < J1939_TP_SESSIONS; i++)
+    {
+        J1939TpSession& session = j1939Sessions[i];
+        if (!session.active || now_us - session.lastActivity_us < J1939_TP_TIMEOUT_MS * 1000)
+            continue;
+        session.active = false;
+        if (!session.bam)
+            j1939SendTpCm(session.source, J1939_TP_ABORT, J1939_ABORT_TIMEOUT, 0xFF, 0xFF, 0xFF, session.pgn);
+    }
+}
+
+// Runs in the CAN receiver task, only hands the frame over
+static void j1939Listener(const CanMessage& msg)
+{
+    if (msg.extd && !msg.rtr)
+        xQueueSend(j1939RxQueue, &msg, 0);
+}
+
+static void j1939Task(void* arg)
+{
+    j1939SendAddressClaim();
+
+    while (j1939Running.load(std::memory_order_acquire))
+    {
+        CanMessage msg;
+        TickType_t wait = pdMS_TO_TICKS(J1939_TICK_MS);
+        while (xQueueReceive(j1939RxQueue, &msg, wait) == pdTRUE)
+        {
+            j1939ProcessFrame(msg, esp_timer_get_time());
+            wait = 0;
+        }
+        j1939CheckTimeouts(esp_timer_get_time());
+    }
+
+    j1939TaskHandle = NULL;
+    vTaskDelete(NULL);
+}
+
+bool EQSP32::startJ1939(uint8_t preferredAddress, uint64_t name, const J1939SpnDescriptor* spns, int spnCount)
+{
+    if (preferredAddress >= J1939_NULL_ADDRESS || spnCount < 0 || spnCount > 0xFFFF || (spnCount > 0 && spns == nullptr))
+        return false;
+    if (j1939Running.load(std::memory_order_acquire))
+        stopJ1939();
+
+    if (!startCANReceiver() || !startCANTransmitter())
+        return false;
+
+    if (j1939RxQueue == NULL)
+        j1939RxQueue = xQueueCreate(J1939_RX_QUEUE_SIZE, sizeof(CanMessage));
+    if (j1939RxQueue == NULL)
+        return false;
+    xQueueReset(j1939RxQueue);
+
+    if (j1939TpBuffer == nullptr)
+        j1939TpBuffer = (uint8_t*)memoryAlloc(MEMORY_J1939, J1939_TP_SESSIONS * J1939_TP_MAX_SIZE);
+    if (j1939TpBuffer == nullptr || !j1939BuildTable(spns, spnCount))
+        return false;
+
+    memset(j1939Sessions, 0, sizeof(j1939Sessions));
+    for (int i = 0; i < J1939_TP_SESSIONS; i++)
+        j1939Sessions[i].data = &j1939TpBuffer[i * J1939_TP_MAX_SIZE];
+    memset(j1939ClaimedByOthers, 0, sizeof(j1939ClaimedByOthers));
+    j1939Name = name;
+    j1939PreferredAddress = preferredAddress;
+    j1939Address.store(preferredAddress);
+    j1939Running.store(true, std::memory_order_release);
+
+    if (xTaskCreatePinnedToCore(j1939Task, "EQSP32_J1939", J1939_TASK_STACK, NULL,
+                                J1939_TASK_PRIORITY, &j1939TaskHandle, tskNO_AFFINITY) != pdPASS)
+    {
+        j1939Running.store(false, std::memory_order_release);
+        return false;
+    }
+
+    canAddListener(j1939Listener);
+    return true;
+}
+
+void EQSP32::stopJ1939()
+{
+    canRemoveListener(j1939Listener);
+
+    if (!j1939Running.exchange(false))
+        return;
+
+    while (j1939TaskHandle != NULL)
+        vTaskDelay(pdMS_TO_TICKS(1));
+
+    j1939Address.store(J1939_NULL_ADDRESS);
+}
+
+uint8_t EQSP32::getJ1939Address()
+{
+    return j1939Address.load();
+}
+
+// Byte sized parameters reserve a range by their most significant byte: 0xFE.. is "error", 0xFF.. is "not available".
+// Discrete parameters use all ones for "not available" and all ones minus one for "error".
+static bool j1939IsErrorOrNA(uint32_t raw, uint8_t bitLength)
+{
+    if (bitLength >= 8 && bitLength % 8 == 0)
+        return (raw >> (bitLength - 8)) >= 0xFE;
+    if (bitLength >= 2)
+    {
+        uint32_t max = 0xFFFFFFFFu >> (32 - bitLength);
+        return raw == max || raw == max - 1;
+    }
+    return false;
+}
+
+bool EQSP32::readJ1939Spn(uint32_t spn, float& value, uint32_t* age_ms)
+{
+    uint32_t raw = 0;
+    uint32_t timestamp = 0;
+    J1939SpnDescriptor desc;
+    bool received = false;
+
+    portENTER_CRITICAL(&j1939Mux);
+    J1939Spn* entry = j1939FindSpn(spn);
+    if (entry != nullptr && entry->received)
+    {
+        raw = entry->raw;
+        desc = entry->desc;
+        timestamp = j1939FindPgn(desc.pgn)->timestamp;
+        received = true;
+    }
+    portEXIT_CRITICAL(&j1939Mux);
+
+    if (!received)
+        return false;
+
+    if (j1939IsErrorOrNA(raw, desc.bitLength))
+        return false;
+
+    value = raw * desc.resolution + desc.offset;
+    if (age_ms != nullptr)
+        *age_ms = millis() - timestamp;
+    return true;
+}
+
+bool EQSP32::readJ1939SpnRaw(uint32_t spn, uint32_t& raw)
+{
+    bool received = false;
+
+    portENTER_CRITICAL(&j1939Mux);
+    J1939Spn* entry = j1939FindSpn(spn);
+    if (entry != nullptr && entry->received)
+    {
+        raw = entry->raw;
+        received = true;
+    }
+    portEXIT_CRITICAL(&j1939Mux);
+
+    return received;
+}
+
+uint32_t EQSP32::getJ1939PgnTimestamp(uint32_t pgn)
+{
+    uint32_t timestamp = 0;
+
+    portENTER_CRITICAL(&j1939Mux);
+    J1939Pgn* entry = j1939FindPgn(pgn);
+    if (entry != nullptr)
+        timestamp = entry->timestamp;
+    portEXIT_CRITICAL(&j1939Mux);
+
+    return timestamp;
+}
@@ -0,0 +1,157 @@
+#include "Task_Handling.h"
+
+#include <atomic>
+
+#define MEMORY_DIAG_TASK_STACK      3072
+#define MEMORY_DIAG_TASK_PRIORITY   1
+#define MEMORY_DIAG_STOP_POLL       pdMS_TO_TICKS(20)       // Bounds stop latency with long publish periods
+
+
+/*  ***********************************************
+     ---   ---   ---   ---   ---   ---   ---   ---
+    Memory diagnostics
+     ---   ---   ---   ---   ---   ---   ---   ---
+    ***********************************************   */
+// Tasks created by the library core, the optional protocol services and the Arduino core
+static const char* const memoryDiagTasks[] = {
+    "EQSP32_SystemManager",
+    "EQSP32_DatabaseHandler",
+    "EQSP32_EQConnectHandler",
+    "EQSP32_MqttDevice",
+    "EQSP32_xModuleManager",
+    "EQBuzzerTask",
+    "EQSP32_CanRx",
+    "EQSP32_CanTx",
+    "EQSP32_CANopen",
+    "EQSP32_J1939",
+    "EQSP32_CanBrdg",
+    "EQSP32_MbMaster",
+    "EQSP32_MbSlave",
+    "EQSP32_MbScan",
+    "EQSP32_MbTcp",
+    "EQSP32_UBoolSub",
+    "EQSP32_TmrWheel",
+    "EQSP32_Sched",
+    "EQSP32_MemDiag",
+    "EQSP32_NvsCache",
+    "loopTask",
+    "arduino_events",
+};
+
+static uint32_t memoryDiagPeriod_ms = 60000;
+static std::atomic<bool> memoryDiagRunning(false);
+static TaskHandle_t memoryDiagTaskHandle = NULL;
+
+static float memoryFragmentation(uint32_t free, uint32_t largestBlock)
+{
+    return free > 0 ? 100.0f * (1.0f - (float)largestBlock / free) : 0;
+}
+
+static void memoryDiagPublish(EQSP32* eq)
+{
+    MemoryStats stats = eq->getMemoryStats();
+
+    uint32_t minHeadroom = 0;
+    for (int i = 0; i < stats.taskCount; i++)
+        if (i == 0 || stats.tasks[i].stackHeadroom < minHeadroom)
+            minHeadroom = stats.tasks[i].stackHeadroom;
+
+    updateDisplay_Sensor("Heap Free", stats.internalFree);
+    updateDisplay_Sensor("Heap Largest Block", stats.internalLargestBlock);
+    updateDisplay_Sensor("Heap Min Free", stats.internalMinFree);
+    updateDisplay_Sensor("Heap Fragmentation", stats.internalFragmentation);
+    if (stats.psramSize > 0)
+        updateDisplay_Sensor("PSRAM Free", stats.psramFree);
+    updateDisplay_Sensor("Min Stack Headroom", minHeadroom);
+}
+
+static void memoryDiagTask(void* arg)
+{
+    EQSP32* eq = (EQSP32*)arg;
+    TickType_t nextPublish = xTaskGetTickCount();
+
+    while (memoryDiagRunning.load(std::memory_order_acquire))
+    {
+        int32_t wait = (int32_t)(nextPublish - xTaskGetTickCount());
+        if (wait > 0)
+        {
+            vTaskDelay(wait < MEMORY_DIAG_STOP_POLL ? wait : MEMORY_DIAG_STOP_POLL);
+            continue;
+        }
+
+        nextPublish += pdMS_TO_TICKS(memoryDiagPeriod_ms);
+        memoryDiagPublish(eq);
+    }
+
+    memoryDiagTaskHandle = NULL;
+    vTaskDelete(NULL);
+}
+
+MemoryStats EQSP32::getMemoryStats()
+{
+    MemoryStats stats;
+
+    const uint32_t internalCaps = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+    stats.internalFree = heap_caps_get_free_size(internalCaps);
+    stats.internalLargestBlock = heap_caps_get_largest_free_block(internalCaps);
+    stats.internalMinFree = heap_caps_get_minimum_free_size(internalCaps);
+    stats.internalFragmentation = memoryFragmentation(stats.internalFree, stats.internalLargestBlock);
+
+    stats.psramSize = heap_caps_get_total_size(MALLOC_CAP_SPIRAM);
+    if (stats.psramSize > 0)
+    {
+        stats.psramFree = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+        stats.psramLargestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM);
+        stats.psramMinFree = heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM);
+        stats.psramFragmentation = memoryFragmentation(stats.psramFree, stats.psramLargestBlock);
+    }
+
+    for (const char* name : memoryDiagTasks)
+    {
+        TaskHandle_t task = taskFindByName(name);
+        if (task == NULL || stats.taskCount >= MEMORY_STATS_MAX_TASKS)
+            continue;
+
+        TaskStackStats& entry = stats.tasks[stats.taskCount++];
+        strncpy(entry.name, name, sizeof(entry.name) - 1);
+        entry.stackHeadroom = uxTaskGetStackHighWaterMark(task);       // ESP-IDF stacks are counted in bytes
+    }
+
+    return stats;
+}
+
+bool EQSP32::startMemoryDiagnostics(uint32_t period_ms)
+{
+    if (period_ms == 0)
+        return false;
+    if (memoryDiagRunning.load(std::memory_order_acquire))
+        stopMemoryDiagnostics();
+
+    createDisplay_Sensor("Heap Free", 0, "B");
+    createDisplay_Sensor("Heap Largest Block", 0, "B");
+    createDisplay_Sensor("Heap Min Free", 0, "B");
+    createDisplay_Sensor("Heap Fragmentation", 1, "%");
+    if (heap_caps_get_total_size(MALLOC_CAP_SPIRAM) > 0)
+        createDisplay_Sensor("PSRAM Free", 0, "B");
+    createDisplay_Sensor("Min Stack Headroom", 0, "B");
+
+    memoryDiagPeriod_ms = period_ms;
+    memoryDiagRunning.store(true, std::memory_order_release);
+
+    if (xTaskCreatePinnedToCore(memoryDiagTask, "EQSP32_MemDiag", MEMORY_DIAG_TASK_STACK, this,
+                                MEMORY_DIAG_TASK_PRIORITY, &memoryDiagTaskHandle, tskNO_AFFINITY) != pdPASS)
+    {
+        memoryDiagRunning.store(false, std::memory_order_release);
+        return false;
+    }
+    return true;
+}
+
+void EQSP32::stopMemoryDiagnostics()
+{
+    if (!memoryDiagRunning.exchange(false))
+        return;
+
+    while (memoryDiagTaskHandle != NULL)
+        vTaskDelay(pdMS_TO_TICKS(1));
+}
@@ -0,0 +1,124 @@
+#include "Memory_Handling.h"
+
+#include <esp_heap_caps.h>
+
+#define MEMORY_LIBRARY_PSRAM_THRESHOLD  1024        // malloc() requests from this size go to PSRAM
+
+#ifdef CONFIG_SPIRAM_MALLOC_ALWAYSINTERNAL
+#define MEMORY_LIBRARY_DEFAULT_THRESHOLD    CONFIG_SPIRAM_MALLOC_ALWAYSINTERNAL     // Set by the core at boot
+#else
+#define MEMORY_LIBRARY_DEFAULT_THRESHOLD    4096
+#endif
+
+
+/*  ***********************************************
+     ---   ---   ---   ---   ---   ---   ---   ---
+    Memory placement
+     ---   ---   ---   ---   ---   ---   ---   ---
+    ***********************************************   */
+// Prepended to every block, so memoryFree knows the size and heap without the caller keeping them
+typedef struct {
+    uint32_t size;
+    uint8_t subsystem;
+    bool psram;
+    uint8_t reserved[2];
+} MemoryBlockHeader;
+
+static_assert(sizeof(MemoryBlockHeader) == 8, "Block header must keep 8-byte alignment");
+
+static const MemoryPlacement memoryDefaultPlacements[MEMORY_SUBSYSTEMS] = {
+    MEMORY_INTERNAL,            // MEMORY_CAN
+    MEMORY_INTERNAL,            // MEMORY_SERIAL
+    MEMORY_PREFER_PSRAM,        // MEMORY_J1939
+    MEMORY_DEFAULT,             // MEMORY_LIBRARY, the core's threshold
+};
+
+static MemoryPlacement memoryPlacements[MEMORY_SUBSYSTEMS] = {
+    MEMORY_INTERNAL,
+    MEMORY_INTERNAL,
+    MEMORY_PREFER_PSRAM,
+    MEMORY_DEFAULT,
+};
+
+static MemoryPlacementStats memoryPlacementStats[MEMORY_SUBSYSTEMS];
+static portMUX_TYPE memoryPlacementMux = portMUX_INITIALIZER_UNLOCKED;
+
+void* memoryAlloc(MemorySubsystem subsystem, size_t size)
+{
+    size_t total = size + sizeof(MemoryBlockHeader);
+    MemoryBlockHeader* block = nullptr;
+    bool psram = false;
+
+    if (memoryPlacements[subsystem] == MEMORY_PREFER_PSRAM && heap_caps_get_total_size(MALLOC_CAP_SPIRAM) > 0)
+    {
+        block = (MemoryBlockHeader*)heap_caps_malloc(total, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        psram = block != nullptr;
+    }
+    if (block == nullptr)
+        block = (MemoryBlockHeader*)heap_caps_malloc(total, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+
+    portENTER_CRITICAL(&memoryPlacementMux);
+    MemoryPlacementStats& stats = memoryPlacementStats[subsystem];
+    if (block == nullptr)
+        stats.failures++;
+    else if (psram)
+        stats.psramBytes += size;
+    else
+        stats.internalBytes += size;
+    portEXIT_CRITICAL(&memoryPlacementMux);
+
+    if (block == nullptr)
+        return nullptr;
+
+    block->size = size;
+    block->subsystem = subsystem;
+    block->psram = psram;
+    return block + 1;
+}
+
+void memoryFree(void* ptr)
+{
+    if (ptr == nullptr)
+        return;
+
+    MemoryBlockHeader* block = (MemoryBlockHeader*)ptr - 1;
+
+    portENTER_CRITICAL(&memoryPlacementMux);
+    MemoryPlacementStats& stats = memoryPlacementStats[block->subsystem];
+    if (block->psram)
+        stats.psramBytes -= block->size;
+    else
+        stats.internalBytes -= block->size;
+    portEXIT_CRITICAL(&memoryPlacementMux);
+
+    heap_caps_free(block);
+}
+
+bool EQSP32::configMemoryPlacement(MemorySubsystem subsystem, MemoryPlacement placement)
+{
+    if (subsystem < 0 || subsystem >= MEMORY_SUBSYSTEMS || placement < MEMORY_INTERNAL || placement > MEMORY_DEFAULT)
+        return false;
+
+    if (placement == MEMORY_DEFAULT)
+        placement = memoryDefaultPlacements[subsystem];
+    memoryPlacements[subsystem] = placement;
+
+    // Process wide, the threshold also applies to the sketch and lwIP
+    if (subsystem == MEMORY_LIBRARY)
+        heap_caps_malloc_extmem_enable(placement == MEMORY_PREFER_PSRAM ? MEMORY_LIBRARY_PSRAM_THRESHOLD :
+                                       placement == MEMORY_INTERNAL ? SIZE_MAX : MEMORY_LIBRARY_DEFAULT_THRESHOLD);
+    return true;
+}
+
+MemoryPlacementStats EQSP32::getMemoryPlacementStats(MemorySubsystem subsystem)
+{
+    MemoryPlacementStats stats;
+    if (subsystem < 0 || subsystem >= MEMORY_SUBSYSTEMS)
+        return stats;
+
+    portENTER_CRITICAL(&memoryPlacementMux);
+    stats = memoryPlacementStats[subsystem];
+    portEXIT_CRITICAL(&memoryPlacementMux);
+
+    return stats;
+}
@@ -0,0 +1,10 @@
+#ifndef Memory_Handling_h
+#define Memory_Handling_h
+
+#include "EQSP32.h"
+
+// Buffers of the library services are allocated with the placement configured for their subsystem (see configMemoryPlacement)
+void* memoryAlloc(MemorySubsystem subsystem, size_t size);
+void memoryFree(void* ptr);
+
+#endif
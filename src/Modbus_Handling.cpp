@@ -0,0 +1,37 @@
+#include "Modbus_Handling.h"
+#include "Serial_Handling.h"
+
+uint16_t modbusCrc16(const uint8_t* data, size_t length)
+{
+    uint16_t crc = 0xFFFF;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+
+    return crc;
+}
+
+uint32_t modbusFrameGap_us(int baud)
+{
+    if (baud <= 0 || baud > 19200)
+        return 1750;
+    return (uint32_t)(3.5 * 11 * 1000000 / baud);       // 11 bits per character
+}
+
+void modbusConfigSerial(EQSP32* eq, int baud)
+{
+    if (serialRS485Auto())
+        eq->configRS485Auto(baud, serialRS485AutoInvert());
+    else
+        eq->configSerial(RS485_RX, baud);
+}
+
+void modbusSetTransmit(EQSP32* eq, bool transmit, int baud)
+{
+    if (!serialRS485Auto())         // Otherwise the UART drives the enable pin
+        eq->configSerial(transmit ? RS485_TX : RS485_RX, baud);
+}
@@ -0,0 +1,38 @@
+#ifndef Modbus_Handling_h
+#define Modbus_Handling_h
+
+#include "EQSP32.h"
+
+#define MODBUS_MAX_ADU              256     // RTU frame: address + PDU (253 bytes) + CRC
+#define MODBUS_MAX_PDU              253
+#define MODBUS_MAX_READ_REGISTERS   125
+#define MODBUS_MAX_READ_BITS        2000
+
+#define MODBUS_EX_ILLEGAL_FUNCTION  0x01
+#define MODBUS_EX_ILLEGAL_ADDRESS   0x02
+#define MODBUS_EX_ILLEGAL_VALUE     0x03
+#define MODBUS_EX_DEVICE_FAILURE    0x04
+#define MODBUS_EX_DEVICE_BUSY       0x06
+
+#define MODBUS_BROADCAST_ADDRESS    0
+
+uint16_t modbusCrc16(const uint8_t* data, size_t length);
+
+// 3.5 character silence that delimits RTU frames, fixed at 1750us above 19200 baud
+uint32_t modbusFrameGap_us(int baud);
+
+// Sets the baud rate and leaves the RS485 transceiver receiving, keeping automatic direction control if enabled
+void modbusConfigSerial(EQSP32* eq, int baud);
+
+// Switches the RS485 transceiver between transmit and receive, no-op with automatic direction control
+void modbusSetTransmit(EQSP32* eq, bool transmit, int baud);
+
+// Scan image shared by the RTU slave and TCP server. Start/stop are reference counted.
+bool modbusServerStart(EQSP32* eq);
+void modbusServerStop();
+
+// Serves a request PDU (function code and data) from the scan image, queueing any writes.
+// Returns the response PDU length, written to response (MODBUS_MAX_PDU bytes).
+size_t modbusServePdu(const uint8_t* request, size_t length, uint8_t* response);
+
+#endif
@@ -0,0 +1,470 @@
+#include "Modbus_Handling.h"
+#include "Serial_Handling.h"
+#include "Task_Handling.h"
+
+#include <atomic>
+
+#define MODBUS_MASTER_TASK_STACK    4096
+#define MODBUS_MASTER_TASK_PRIORITY TASK_PRIORITY_PROTOCOL
+#define MODBUS_MASTER_POLL_SLOTS    32
+#define MODBUS_MASTER_STATS_SLOTS   16      // Slaves with tracked statistics
+#define MODBUS_MASTER_WRITE_QUEUE   16
+#define MODBUS_MASTER_IDLE_MS       5       // Max sleep while no poll is due, bounds stop latency
+
+
+/*  ***********************************************
+     ---   ---   ---   ---   ---   ---   ---   ---
+    Modbus master poll table
+     ---   ---   ---   ---   ---   ---   ---   ---
+    ***********************************************   */
+typedef struct {
+    bool used;
+    uint8_t slave;
+    uint8_t function;
+    uint16_t address;
+    uint16_t count;
+    uint32_t period_ms;
+    uint32_t generation;        // Changes whenever the range changes, invalidates in-flight responses
+    int64_t nextDue_us;
+    uint32_t timestamp;         // millis() of the last valid response, 0 if never
+    uint16_t values[MODBUS_MAX_READ_REGISTERS];     // Registers, or bits packed 16 per word
+} ModbusPollBlock;
+
+typedef struct {
+    uint8_t slave;
+    uint8_t function;
+    uint16_t address;
+    uint16_t value;
+} ModbusWrite;
+
+static ModbusPollBlock mbPolls[MODBUS_MASTER_POLL_SLOTS];
+static portMUX_TYPE mbPollMux = portMUX_INITIALIZER_UNLOCKED;
+
+static ModbusSlaveStats mbStats[MODBUS_MASTER_STATS_SLOTS];
+static uint8_t mbStatsSlave[MODBUS_MASTER_STATS_SLOTS];        // 0 marks a free slot
+static portMUX_TYPE mbStatsMux = portMUX_INITIALIZER_UNLOCKED;
+
+static EQSP32* mbEQ = nullptr;
+static int mbBaud = 9600;
+static uint32_t mbTimeout_ms = 100;
+static uint32_t mbFrameGap_us = 1750;
+static int64_t mbLastActivity_us = 0;
+
+static std::atomic<bool> mbRunning(false);
+static QueueHandle_t mbWriteQueue = NULL;
+static TaskHandle_t mbTaskHandle = NULL;
+
+static bool isModbusBitFunction(uint8_t function)
+{
+    return function == MODBUS_READ_COILS || function == MODBUS_READ_DISCRETE_INPUTS;
+}
+
+// Must be called with mbStatsMux held
+static ModbusSlaveStats* modbusStatsFor(uint8_t slave, bool create)
+{
+    for (int i = 0; i < MODBUS_MASTER_STATS_SLOTS; i++)
+        if (mbStatsSlave[i] == slave)
+            return &mbStats[i];
+
+    if (!create)
+        return nullptr;
+
+    for (int i = 0; i < MODBUS_MASTER_STATS_SLOTS; i++)
+    {
+        if (mbStatsSlave[i] == 0)
+        {
+            mbStatsSlave[i] = slave;
+            mbStats[i] = ModbusSlaveStats();
+            return &mbStats[i];
+        }
+    }
+    return nullptr;
+}
+
+enum ModbusResult { MB_OK, MB_TIMEOUT, MB_BAD_FRAME, MB_EXCEPTION };
+
+static void modbusRecordResult(uint8_t slave, ModbusResult result, uint8_t exception, uint32_t latency_us)
+{
+    portENTER_CRITICAL(&mbStatsMux);
+    ModbusSlaveStats* stats = modbusStatsFor(slave, true);
+    if (stats != nullptr)
+    {
+        stats->requests++;
+        switch (result)
+        {
+            case MB_TIMEOUT:
+                stats->timeouts++;
+                break;
+            case MB_BAD_FRAME:
+                stats->crcErrors++;
+                break;
+            case MB_EXCEPTION:
+                stats->exceptions++;
+                stats->lastException = exception;
+                // fall through
+            case MB_OK:
+                stats->responses++;
+                // Running average over the valid responses
+                stats->avgLatency_us += ((int64_t)latency_us - stats->avgLatency_us) / (int64_t)stats->responses;
+                if (latency_us > stats->maxLatency_us)
+                    stats->maxLatency_us = latency_us;
+                break;
+        }
+    }
+    portEXIT_CRITICAL(&mbStatsMux);
+}
+
+
+/*  ***********************************************
+     ---   ---   ---   ---   ---   ---   ---   ---
+    Modbus RTU transactions
+     ---   ---   ---   ---   ---   ---   ---   ---
+    ***********************************************   */
+static ModbusResult modbusTransact(uint8_t* frame, size_t length, uint8_t* response, size_t expected, uint8_t& exception)
+{
+    HardwareSerial& port = mbEQ->Serial;
+    uint8_t slave = frame[0];
+    uint8_t function = frame[1];
+
+    uint16_t crc = modbusCrc16(frame, length);
+    frame[length++] = crc & 0xFF;
+    frame[length++] = crc >> 8;
+
+    // Inter-frame silence since the end of the previous response
+    int64_t idle_us = esp_timer_get_time() - mbLastActivity_us;
+    if (idle_us < mbFrameGap_us)
+        delayMicroseconds(mbFrameGap_us - idle_us);
+
+    while (port.available())
+        port.read();        // Discard late or unsolicited bytes
+
+    int64_t start_us = esp_timer_get_time();
+    modbusSetTransmit(mbEQ, true, mbBaud);
+    port.write(frame, length);
+    port.flush();           // Returns once the last stop bit is out
+    modbusSetTransmit(mbEQ, false, mbBaud);
+    mbLastActivity_us = esp_timer_get_time();
+
+    if (slave == MODBUS_BROADCAST_ADDRESS)
+        return MB_OK;
+
+    size_t received = 0;
+    int64_t lastByte_us = 0;
+    while (true)
+    {
+        int64_t now_us = esp_timer_get_time();
+        if (port.available())
+        {
+            while (port.available() && received < MODBUS_MAX_ADU)
+                response[received++] = port.read();
+            lastByte_us = now_us;
+
+            if (received >= 2 && (response[1] & 0x80))
+                expected = 5;       // Exception response
+            if (received >= expected)
+                break;
+            continue;
+        }
+        if (received > 0 && now_us - lastByte_us > mbFrameGap_us)
+            break;                  // Short frame, ended by the inter-frame silence
+        if (received == 0 && now_us - start_us > (int64_t)mbTimeout_ms * 1000)
+            break;
+        vTaskDelay(1);
+    }
+    mbLastActivity_us = esp_timer_get_time();
+    uint32_t latency_us = mbLastActivity_us - start_us;
+
+    ModbusResult result;
+    if (received == 0)
+        result = MB_TIMEOUT;
+    else if (received < 5 || received != expected || response[0] != slave || (response[1] & 0x7F) != function ||
+             modbusCrc16(response, received - 2) != (response[received - 2] | (response[received - 1] << 8)))
+        result = MB_BAD_FRAME;
+    else if (response[1] & 0x80)
+    {
+        exception = response[2];
+        result = MB_EXCEPTION;
+    }
+    else
+        result = MB_OK;
+
+    modbusRecordResult(slave, result, exception, latency_us);
+    return result;
+}
+
+static void modbusExecuteWrite(const ModbusWrite& write)
+{
+    uint8_t frame[8] = {write.slave, write.function, (uint8_t)(write.address >> 8), (uint8_t)write.address,
+                        (uint8_t)(write.value >> 8), (uint8_t)write.value};
+    uint8_t response[MODBUS_MAX_ADU];
+    uint8_t exception = 0;
+
+    modbusTransact(frame, 6, response, 8, exception);       // Echo of the request
+}
+
+static void modbusExecutePoll(int slot, int64_t now_us)
+{
+    ModbusPollBlock poll;
+
+    portENTER_CRITICAL(&mbPollMux);
+    ModbusPollBlock& block = mbPolls[slot];
+    poll.slave = block.slave;
+    poll.function = block.function;
+    poll.address = block.address;
+    poll.count = block.count;
+    poll.generation = block.generation;
+    // Next period, without repeating missed ones
+    block.nextDue_us += (int64_t)block.period_ms * 1000;
+    if (block.nextDue_us < now_us)
+        block.nextDue_us = now_us + (int64_t)block.period_ms * 1000;
+    portEXIT_CRITICAL(&mbPollMux);
+
+    bool bits = isModbusBitFunction(poll.function);
+    size_t dataBytes = bits ? (poll.count + 7) / 8 : poll.count * 2;
+    uint8_t frame[8] = {poll.slave, poll.function, (uint8_t)(poll.address >> 8), (uint8_t)poll.address,
+                        (uint8_t)(poll.count >> 8), (uint8_t)poll.count};
+    uint8_t response[MODBUS_MAX_ADU];
+    uint8_t exception = 0;
+
+    if (modbusTransact(frame, 6, response, 5 + dataBytes, exception) != MB_OK || response[2] != dataBytes)
+        return;
+
+    uint32_t now = millis();
+
+    portENTER_CRITICAL(&mbPollMux);
+    if (block.used && block.generation == poll.generation)
+    {
+        if (bits)
+        {
+            memset(block.values, 0, sizeof(block.values));
+            for (int i = 0; i < poll.count; i++)
+                if (response[3 + i / 8] & (1 << (i % 8)))
+                    block.values[i / 16] |= 1 << (i % 16);
+        }
+        else
+        {
+            for (int i = 0; i < poll.count; i++)
+                block.values[i] = (response[3 + 2 * i] << 8) | response[4 + 2 * i];
+        }
+        block.timestamp = now != 0 ? now : 1;
+    }
+    portEXIT_CRITICAL(&mbPollMux);
+}
+
+static void modbusMasterTask(void* arg)
+{
+    while (mbRunning.load(std::memory_order_acquire))
+    {
+        ModbusWrite write;
+        while (xQueueReceive(mbWriteQueue, &write, 0) == pdTRUE)
+            modbusExecuteWrite(write);
+
+        // Most overdue poll first
+        int64_t now_us = esp_timer_get_time();
+        int64_t nextDue_us = now_us + MODBUS_MASTER_IDLE_MS * 1000;
+        int due = -1;
+
+        portENTER_CRITICAL(&mbPollMux);
+        for (int i = 0; i < MODBUS_MASTER_POLL_SLOTS; i++)
+        {
+            if (mbPolls[i].used && mbPolls[i].nextDue_us < nextDue_us)
+            {
+                nextDue_us = mbPolls[i].nextDue_us;
+                due = i;
+            }
+        }
+        portEXIT_CRITICAL(&mbPollMux);
+
+        if (due >= 0 && nextDue_us <= now_us)
+        {
+            modbusExecutePoll(due, now_us);
+            continue;
+        }
+
+        // Sleep until the next poll, waking up early for writes
+        TickType_t wait = pdMS_TO_TICKS((nextDue_us - now_us) / 1000);
+        if (xQueueReceive(mbWriteQueue, &write, wait > 0 ? wait : 1) == pdTRUE)
+            modbusExecuteWrite(write);
+    }
+
+    mbTaskHandle = NULL;
+    vTaskDelete(NULL);
+}
+
+bool EQSP32::startModbusMaster(int baud, uint32_t timeout_ms)
+{
+    if (baud <= 0)
+        return false;
+    if (mbRunning.load(std::memory_order_acquire))
+        stopModbusMaster();
+
+    if (mbWriteQueue == NULL)
+        mbWriteQueue = xQueueCreate(MODBUS_MASTER_WRITE_QUEUE, sizeof(ModbusWrite));
+    if (mbWriteQueue == NULL || !serialClaimPort())
+        return false;
+    xQueueReset(mbWriteQueue);
+
+    mbEQ = this;
+    mbBaud = baud;
+    mbTimeout_ms = timeout_ms;
+    mbFrameGap_us = modbusFrameGap_us(baud);
+    mbLastActivity_us = esp_timer_get_time();
+    modbusConfigSerial(this, baud);
+
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&mbPollMux);
+    for (int i = 0; i < MODBUS_MASTER_POLL_SLOTS; i++)
+        mbPolls[i].nextDue_us = now_us;
+    portEXIT_CRITICAL(&mbPollMux);
+
+    mbRunning.store(true, std::memory_order_release);
+    if (xTaskCreatePinnedToCore(modbusMasterTask, "EQSP32_MbMaster", MODBUS_MASTER_TASK_STACK, NULL,
+                                MODBUS_MASTER_TASK_PRIORITY, &mbTaskHandle, tskNO_AFFINITY) != pdPASS)
+    {
+        mbRunning.store(false, std::memory_order_release);
+        serialReleasePort();
+        return false;
+    }
+    return true;
+}
+
+void EQSP32::stopModbusMaster()
+{
+    if (!mbRunning.exchange(false))
+        return;
+
+    while (mbTaskHandle != NULL)
+        vTaskDelay(pdMS_TO_TICKS(1));
+
+    serialReleasePort();
+}
+
+bool EQSP32::addModbusPoll(uint8_t slave, ModbusFunction function, uint16_t address, uint16_t count, uint32_t period_ms)
+{
+    if (slave < 1 || slave > 247 || function < MODBUS_READ_COILS || function > MODBUS_READ_INPUT_REGISTERS || period_ms == 0)
+        return false;
+
+    uint32_t limit = isModbusBitFunction(function) ? MODBUS_MAX_READ_BITS : MODBUS_MAX_READ_REGISTERS;
+    uint32_t first = address;
+    uint32_t last = first + count;      // Exclusive
+    if (count == 0 || count > limit || last > 0x10000)
+        return false;
+
+    bool added = false;
+
+    portENTER_CRITICAL(&mbPollMux);
+    for (int i = 0; i < MODBUS_MASTER_POLL_SLOTS && !added; i++)
+    {
+        ModbusPollBlock& block = mbPolls[i];
+        if (!block.used || block.slave != slave || block.function != function || block.period_ms != period_ms)
+            continue;
+
+        uint32_t blockLast = block.address + block.count;
+        if (first > blockLast || last < block.address)
+            continue;       // Neither overlapping nor adjoining
+
+        uint32_t mergedFirst = first < block.address ? first : block.address;
+        uint32_t mergedLast = last > blockLast ? last : blockLast;
+        if (mergedLast - mergedFirst > limit)
+            continue;
+
+        if (mergedFirst != block.address || mergedLast != blockLast)
+        {
+            block.address = mergedFirst;
+            block.count = mergedLast - mergedFirst;
+            block.generation++;
+            block.timestamp = 0;
+        }
+        added = true;
+    }
+    for (int i = 0; i < MODBUS_MASTER_POLL_SLOTS && !added; i++)
+    {
+        ModbusPollBlock& block = mbPolls[i];
+        if (block.used)
+            continue;
+
+        block.slave = slave;
+        block.function = function;
+        block.address = address;
+        block.count = count;
+        block.period_ms = period_ms;
+        block.generation++;
+        block.nextDue_us = esp_timer_get_time();
+        block.timestamp = 0;
+        block.used = true;
+        added = true;
+    }
+    portEXIT_CRITICAL(&mbPollMux);
+
+    return added;
+}
+
+void EQSP32::clearModbusPolls()
+{
+    portENTER_CRITICAL(&mbPollMux);
+    for (int i = 0; i < MODBUS_MASTER_POLL_SLOTS; i++)
+    {
+        mbPolls[i].used = false;
+        mbPolls[i].generation++;
+    }
+    portEXIT_CRITICAL(&mbPollMux);
+}
+
+bool EQSP32::readModbusValue(uint8_t slave, ModbusFunction function, uint16_t address, uint16_t& value, uint32_t* age_ms)
+{
+    uint32_t timestamp = 0;
+
+    // The same value may be polled by several entries, return the most recent
+    portENTER_CRITICAL(&mbPollMux);
+    for (int i = 0; i < MODBUS_MASTER_POLL_SLOTS; i++)
+    {
+        const ModbusPollBlock& block = mbPolls[i];
+        if (!block.used || block.slave != slave || block.function != function || block.timestamp == 0 ||
+            address < block.address || address >= block.address + block.count)
+            continue;
+        if (timestamp != 0 && (int32_t)(block.timestamp - timestamp) <= 0)
+            continue;
+
+        int offset = address - block.address;
+        value = isModbusBitFunction(function) ? (block.values[offset / 16] >> (offset % 16)) & 1 : block.values[offset];
+        timestamp = block.timestamp;
+    }
+    portEXIT_CRITICAL(&mbPollMux);
+
+    if (timestamp == 0)
+        return false;
+    if (age_ms != nullptr)
+        *age_ms = millis() - timestamp;
+    return true;
+}
+
+bool EQSP32::writeModbusRegister(uint8_t slave, uint16_t address, uint16_t value)
+{
+    if (!mbRunning.load(std::memory_order_acquire) || slave > 247)
+        return false;
+
+    ModbusWrite write = {slave, MODBUS_WRITE_SINGLE_REGISTER, address, value};
+    return xQueueSend(mbWriteQueue, &write, 0) == pdTRUE;
+}
+
+bool EQSP32::writeModbusCoil(uint8_t slave, uint16_t address, bool value)
+{
+    if (!mbRunning.load(std::memory_order_acquire) || slave > 247)
+        return false;
+
+    ModbusWrite write = {slave, MODBUS_WRITE_SINGLE_COIL, address, (uint16_t)(value ? 0xFF00 : 0x0000)};
+    return xQueueSend(mbWriteQueue, &write, 0) == pdTRUE;
+}
+
+ModbusSlaveStats EQSP32::getModbusSlaveStats(uint8_t slave)
+{
+    ModbusSlaveStats stats;
+
+    portENTER_CRITICAL(&mbStatsMux);
+    ModbusSlaveStats* entry = modbusStatsFor(slave, false);
+    if (entry != nullptr)
+        stats = *entry;
+    portEXIT_CRITICAL(&mbStatsMux);
+
+    return stats;
+}
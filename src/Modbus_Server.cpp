@@ -0,0 +1,376 @@
+#include "Modbus_Handling.h"
+#include "Sampling_Handling.h"
+#include "Task_Handling.h"
+
+#include <atomic>
+
+#define MODBUS_SCAN_TASK_STACK      3072
+#define MODBUS_SCAN_TASK_PRIORITY   (TASK_PRIORITY_PROTOCOL - 1)    // Below the request handlers so multi-writes are applied together
+#define MODBUS_SCAN_PERIOD_MS       10
+#define MODBUS_WRITE_QUEUE_SIZE     64
+
+#define MODBUS_PINS                 16
+#define MODBUS_USER_BOOLS           32
+#define MODBUS_USER_INTS            32
+
+
+/*  ***********************************************
+     ---   ---   ---   ---   ---   ---   ---   ---
+    Modbus scan image
+     ---   ---   ---   ---   ---   ---   ---   ---
+    ***********************************************   */
+typedef struct {
+    int32_t pins[MODBUS_PINS];
+    int32_t userInts[MODBUS_USER_INTS];
+    uint32_t userBools;
+    int32_t inputVoltage;
+    int32_t outputVoltage;
+} ModbusScanImage;
+
+enum ModbusWriteTarget : uint8_t {
+    MB_TARGET_PIN,
+    MB_TARGET_USER_BOOL,
+    MB_TARGET_USER_INT,                 // Both registers of a user int
+    MB_TARGET_USER_INT_HIGH,
+    MB_TARGET_USER_INT_LOW,
+};
+
+typedef struct {
+    ModbusWriteTarget target;
+    uint8_t index;                      // Offset in the register map, user variables are numbered from 1
+    int32_t value;
+} ModbusImageWrite;
+
+// Double buffered: the scan task fills the buffer readers are not using, then bumps the sequence.
+// Readers retry if the sequence moved while they were copying.
+static ModbusScanImage mbImages[2];
+static std::atomic<uint32_t> mbImageSeq(0);
+
+static EQSP32* mbsEQ = nullptr;
+static int32_t mbPinValues[MODBUS_PINS];       // Last value written to each pin through Modbus, read back for digital pins
+static std::atomic<int> mbServerUsers(0);
+static std::atomic<bool> mbScanRunning(false);
+static QueueHandle_t mbImageWriteQueue = NULL;
+static TaskHandle_t mbScanTaskHandle = NULL;
+
+static void modbusScan()
+{
+    uint32_t seq = mbImageSeq.load(std::memory_order_relaxed);
+    ModbusScanImage& image = mbImages[(seq + 1) & 1];
+
+    // readPin() and readUserBool() reset the edge state of their trigger modes, so the scan never goes through them:
+    // edge reads in loop() would miss edges, and the shared state would be raced from this task. Analog inputs ignore
+    // the trigger modes and are sampled, digital pins read back what Modbus wrote to them.
+    for (int i = 0; i < MODBUS_PINS; i++)
+    {
+        int value;
+        image.pins[i] = pinSampleAnalog(mbsEQ, EQ_PIN_1 + i, value) ? value : mbPinValues[i];
+    }
+
+    image.userBools = 0;
+    for (int i = 0; i < MODBUS_USER_BOOLS; i++)
+        if (userBoolSample(i + 1))
+            image.userBools |= 1u << i;
+
+    for (int i = 0; i < MODBUS_USER_INTS; i++)
+        image.userInts[i] = userIntSample(i + 1);
+
+    image.inputVoltage = mbsEQ->readInputVoltage();
+    image.outputVoltage = mbsEQ->readOutputVoltage();
+
+    mbImageSeq.store(seq + 1, std::memory_order_release);
+}
+
+static void modbusReadImage(ModbusScanImage& image)
+{
+    uint32_t seq;
+    do
+    {
+        seq = mbImageSeq.load(std::memory_order_acquire);
+        memcpy(&image, &mbImages[seq & 1], sizeof(image));
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while (mbImageSeq.load(std::memory_order_relaxed) != seq);
+}
+
+static void modbusApplyWrite(const ModbusImageWrite& write)
+{
+    int value;
+
+    switch (write.target)
+    {
+        case MB_TARGET_PIN:
+            if (mbsEQ->pinValue(EQ_PIN_1 + write.index, write.value))
+                mbPinValues[write.index] = write.value;
+            break;
+        case MB_TARGET_USER_BOOL:
+            mbsEQ->writeUserBool(write.index + 1, write.value != 0);
+            break;
+        case MB_TARGET_USER_INT:
+            mbsEQ->writeUserInt(write.index + 1, write.value);
+            break;
+        case MB_TARGET_USER_INT_HIGH:
+            value = userIntSample(write.index + 1);
+            mbsEQ->writeUserInt(write.index + 1, (int)(((uint32_t)write.value << 16) | ((uint32_t)value & 0xFFFF)));
+            break;
+        case MB_TARGET_USER_INT_LOW:
+            value = userIntSample(write.index + 1);
+            mbsEQ->writeUserInt(write.index + 1, (int)(((uint32_t)value & 0xFFFF0000) | ((uint32_t)write.value & 0xFFFF)));
+            break;
+    }
+}
+
+static void modbusScanTask(void* arg)
+{
+    while (mbScanRunning.load(std::memory_order_acquire))
+    {
+        // Writes queued since the last scan are applied together, then reflected in the next snapshot
+        ModbusImageWrite write;
+        while (xQueueReceive(mbImageWriteQueue, &write, 0) == pdTRUE)
+            modbusApplyWrite(write);
+
+        modbusScan();
+
+        // Wait for the next scan, waking up early for writes
+        xQueuePeek(mbImageWriteQueue, &write, pdMS_TO_TICKS(MODBUS_SCAN_PERIOD_MS));
+    }
+
+    mbScanTaskHandle = NULL;
+    vTaskDelete(NULL);
+}
+
+bool modbusServerStart(EQSP32* eq)
+{
+    if (mbServerUsers.fetch_add(1) > 0)
+        return true;
+
+    if (mbImageWriteQueue == NULL)
+        mbImageWriteQueue = xQueueCreate(MODBUS_WRITE_QUEUE_SIZE, sizeof(ModbusImageWrite));
+    if (mbImageWriteQueue == NULL)
+    {
+        mbServerUsers.fetch_sub(1);
+        return false;
+    }
+
+    mbsEQ = eq;
+    modbusScan();           // Requests are served from a valid image from the start
+    mbScanRunning.store(true, std::memory_order_release);
+
+    if (xTaskCreatePinnedToCore(modbusScanTask, "EQSP32_MbScan", MODBUS_SCAN_TASK_STACK, NULL,
+                                MODBUS_SCAN_TASK_PRIORITY, &mbScanTaskHandle, tskNO_AFFINITY) != pdPASS)
+    {
+        mbScanRunning.store(false, std::memory_order_release);
+        mbServerUsers.fetch_sub(1);
+        return false;
+    }
+    return true;
+}
+
+void modbusServerStop()
+{
+    if (mbServerUsers.fetch_sub(1) != 1)
+        return;
+
+    mbScanRunning.store(false, std::memory_order_release);
+    while (mbScanTaskHandle != NULL)
+        vTaskDelay(pdMS_TO_TICKS(1));
+}
+
+
+/*  ***********************************************
+     ---   ---   ---   ---   ---   ---   ---   ---
+    Modbus request handling
+     ---   ---   ---   ---   ---   ---   ---   ---
+    ***********************************************   */
+static bool modbusReadBit(const ModbusScanImage& image, uint8_t function, uint32_t address, bool& value)
+{
+    if (address < MODBUS_MAP_PIN + MODBUS_PINS)
+    {
+        value = image.pins[address - MODBUS_MAP_PIN] != 0;
+        return true;
+    }
+    if (function == MODBUS_READ_COILS && address >= MODBUS_MAP_USER_BOOL && address < MODBUS_MAP_USER_BOOL + MODBUS_USER_BOOLS)
+    {
+        value = (image.userBools >> (address - MODBUS_MAP_USER_BOOL)) & 1;
+        return true;
+    }
+    return false;
+}
+
+static bool modbusReadRegister(const ModbusScanImage& image, uint8_t function, uint32_t address, uint16_t& value)
+{
+    if (address < MODBUS_MAP_PIN + MODBUS_PINS)
+    {
+        value = (uint16_t)image.pins[address - MODBUS_MAP_PIN];
+        return true;
+    }
+    if (function == MODBUS_READ_HOLDING_REGISTERS && address >= MODBUS_MAP_USER_INT && address < MODBUS_MAP_USER_INT + 2 * MODBUS_USER_INTS)
+    {
+        uint32_t userInt = (uint32_t)image.userInts[(address - MODBUS_MAP_USER_INT) / 2];
+        value = ((address - MODBUS_MAP_USER_INT) & 1) ? userInt & 0xFFFF : userInt >> 16;
+        return true;
+    }
+    if (function == MODBUS_READ_INPUT_REGISTERS && address >= MODBUS_MAP_SUPPLY && address < MODBUS_MAP_SUPPLY + 2)
+    {
+        value = (uint16_t)(address == MODBUS_MAP_SUPPLY ? image.inputVoltage : image.outputVoltage);
+        return true;
+    }
+    return false;
+}
+
+static bool modbusCoilWrite(uint32_t address, bool on, ModbusImageWrite& write)
+{
+    if (address < MODBUS_MAP_PIN + MODBUS_PINS)
+        write = {MB_TARGET_PIN, (uint8_t)(address - MODBUS_MAP_PIN), on ? 1000 : 0};
+    else if (address >= MODBUS_MAP_USER_BOOL && address < MODBUS_MAP_USER_BOOL + MODBUS_USER_BOOLS)
+        write = {MB_TARGET_USER_BOOL, (uint8_t)(address - MODBUS_MAP_USER_BOOL), on};
+    else
+        return false;
+    return true;
+}
+
+static bool modbusRegisterWrite(uint32_t address, uint16_t value, ModbusImageWrite& write)
+{
+    if (address < MODBUS_MAP_PIN + MODBUS_PINS)
+        write = {MB_TARGET_PIN, (uint8_t)(address - MODBUS_MAP_PIN), value};
+    else if (address >= MODBUS_MAP_USER_INT && address < MODBUS_MAP_USER_INT + 2 * MODBUS_USER_INTS)
+        write = {((address - MODBUS_MAP_USER_INT) & 1) ? MB_TARGET_USER_INT_LOW : MB_TARGET_USER_INT_HIGH,
+                 (uint8_t)((address - MODBUS_MAP_USER_INT) / 2), value};
+    else
+        return false;
+    return true;
+}
+
+static uint8_t modbusServeRead(uint8_t function, uint16_t address, uint16_t count, uint8_t* response, size_t& length)
+{
+    bool bits = function == MODBUS_READ_COILS || function == MODBUS_READ_DISCRETE_INPUTS;
+    if (count == 0 || count > (bits ? MODBUS_MAX_READ_BITS : MODBUS_MAX_READ_REGISTERS))
+        return MODBUS_EX_ILLEGAL_VALUE;
+
+    ModbusScanImage image;
+    modbusReadImage(image);
+
+    size_t bytes = bits ? (count + 7) / 8 : count * 2;
+    memset(&response[2], 0, bytes);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (bits)
+        {
+            bool value;
+            if (!modbusReadBit(image, function, address + i, value))
+                return MODBUS_EX_ILLEGAL_ADDRESS;
+            if (value)
+                response[2 + i / 8] |= 1 << (i % 8);
+        }
+        else
+        {
+            uint16_t value;
+            if (!modbusReadRegister(image, function, address + i, value))
+                return MODBUS_EX_ILLEGAL_ADDRESS;
+            response[2 + 2 * i] = value >> 8;
+            response[3 + 2 * i] = value & 0xFF;
+        }
+    }
+
+    response[1] = bytes;
+    length = 2 + bytes;
+    return 0;
+}
+
+static uint8_t modbusServeWrite(const uint8_t* request, size_t requestLength, uint8_t* response, size_t& length)
+{
+    uint8_t function = request[0];
+    uint16_t address = (request[1] << 8) | request[2];
+    uint16_t count = (request[3] << 8) | request[4];
+    bool single = function == MODBUS_WRITE_SINGLE_COIL || function == MODBUS_WRITE_SINGLE_REGISTER;
+    bool coils = function == MODBUS_WRITE_SINGLE_COIL || function == MODBUS_WRITE_MULTIPLE_COILS;
+    ModbusImageWrite writes[2 * MODBUS_USER_INTS];      // Largest writable range
+
+    if (single)
+    {
+        if (coils && count != 0xFF00 && count != 0x0000)
+            return MODBUS_EX_ILLEGAL_VALUE;
+        bool valid = coils ? modbusCoilWrite(address, count != 0, writes[0]) : modbusRegisterWrite(address, count, writes[0]);
+        if (!valid)
+            return MODBUS_EX_ILLEGAL_ADDRESS;
+        count = 1;
+    }
+    else
+    {
+        size_t bytes = coils ? (count + 7) / 8 : count * 2;
+        if (requestLength < 6 || count == 0 || count > (coils ? 1968 : 123) || request[5] != bytes || requestLength < 6 + bytes)
+            return MODBUS_EX_ILLEGAL_VALUE;
+        if (count > sizeof(writes) / sizeof(writes[0]))
+            return MODBUS_EX_ILLEGAL_ADDRESS;
+
+        const uint8_t* data = &request[6];
+        for (uint32_t i = 0; i < count; i++)
+        {
+            bool valid = coils ? modbusCoilWrite(address + i, (data[i / 8] >> (i % 8)) & 1, writes[i])
+                               : modbusRegisterWrite(address + i, (data[2 * i] << 8) | data[2 * i + 1], writes[i]);
+            if (!valid)
+                return MODBUS_EX_ILLEGAL_ADDRESS;
+        }
+    }
+
+    // Both halves of a user int written by the same request are applied with one writeUserInt
+    uint32_t writeCount = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (writes[i].target == MB_TARGET_USER_INT_HIGH && i + 1 < count &&
+            writes[i + 1].target == MB_TARGET_USER_INT_LOW && writes[i + 1].index == writes[i].index)
+        {
+            writes[writeCount++] = {MB_TARGET_USER_INT, writes[i].index,
+                                    (int32_t)(((uint32_t)writes[i].value << 16) | ((uint32_t)writes[i + 1].value & 0xFFFF))};
+            i++;
+        }
+        else
+            writes[writeCount++] = writes[i];
+    }
+
+    // All or nothing, a request is never applied partially
+    if (uxQueueSpacesAvailable(mbImageWriteQueue) < writeCount)
+        return MODBUS_EX_DEVICE_BUSY;
+    for (uint32_t i = 0; i < writeCount; i++)
+        xQueueSend(mbImageWriteQueue, &writes[i], 0);
+
+    // Single writes echo the request, multiple writes echo address and count
+    memcpy(&response[1], &request[1], 4);
+    length = 5;
+    return 0;
+}
+
+size_t modbusServePdu(const uint8_t* request, size_t length, uint8_t* response)
+{
+    if (length < 1)
+        return 0;
+
+    uint8_t function = request[0];
+    uint8_t exception = MODBUS_EX_ILLEGAL_FUNCTION;
+    size_t responseLength = 0;
+
+    response[0] = function;
+    switch (function)
+    {
+        case MODBUS_READ_COILS:
+        case MODBUS_READ_DISCRETE_INPUTS:
+        case MODBUS_READ_HOLDING_REGISTERS:
+        case MODBUS_READ_INPUT_REGISTERS:
+            exception = length < 5 ? MODBUS_EX_ILLEGAL_VALUE
+                                   : modbusServeRead(function, (request[1] << 8) | request[2], (request[3] << 8) | request[4], response, responseLength);
+            break;
+        case MODBUS_WRITE_SINGLE_COIL:
+        case MODBUS_WRITE_SINGLE_REGISTER:
+        case MODBUS_WRITE_MULTIPLE_COILS:
+        case MODBUS_WRITE_MULTIPLE_REGISTERS:
+            exception = length < 5 ? MODBUS_EX_ILLEGAL_VALUE : modbusServeWrite(request, length, response, responseLength);
+            break;
+    }
+
+    if (exception != 0)
+    {
+        response[0] = function | 0x80;
+        response[1] = exception;
+        return 2;
+    }
+    return responseLength;
+}
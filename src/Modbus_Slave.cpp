@@ -0,0 +1,158 @@
+#include "Modbus_Handling.h"
+#include "Serial_Handling.h"
+#include "Task_Handling.h"
+
+#include <atomic>
+
+#define MODBUS_SLAVE_TASK_STACK     4096
+#define MODBUS_SLAVE_TASK_PRIORITY  TASK_PRIORITY_PROTOCOL
+#define MODBUS_SLAVE_FAST_PRIORITY  (configMAX_PRIORITIES - 2)      // With automatic RS485 direction, answer within the turnaround time
+#define MODBUS_SLAVE_IDLE_MS        20                              // Bounds stop latency
+#define MODBUS_SLAVE_RX_TIMEOUT     3                               // UART RX timeout in characters, ends a frame
+
+
+/*  ***********************************************
+     ---   ---   ---   ---   ---   ---   ---   ---
+    Modbus RTU slave
+     ---   ---   ---   ---   ---   ---   ---   ---
+    ***********************************************   */
+static EQSP32* mbSlaveEQ = nullptr;
+static uint8_t mbSlaveAddress = 1;
+static int mbSlaveBaud = 9600;
+
+static std::atomic<bool> mbSlaveRunning(false);
+static TaskHandle_t mbSlaveTaskHandle = NULL;
+
+// Runs in the UART event task when the line goes idle after a frame
+static void modbusSlaveOnReceive()
+{
+    TaskHandle_t task = mbSlaveTaskHandle;
+    if (task != NULL)
+        xTaskNotifyGive(task);
+}
+
+static void modbusSlaveHandleFrame(const uint8_t* frame, size_t length)
+{
+    if (length < 4 || modbusCrc16(frame, length - 2) != (frame[length - 2] | (frame[length - 1] << 8)))
+        return;
+
+    uint8_t address = frame[0];
+    if (address != mbSlaveAddress && address != MODBUS_BROADCAST_ADDRESS)
+        return;
+
+    uint8_t response[MODBUS_MAX_ADU];
+    size_t pduLength = modbusServePdu(&frame[1], length - 3, &response[1]);
+    if (address == MODBUS_BROADCAST_ADDRESS || pduLength == 0)
+        return;
+
+    response[0] = mbSlaveAddress;
+    uint16_t crc = modbusCrc16(response, pduLength + 1);
+    response[pduLength + 1] = crc & 0xFF;
+    response[pduLength + 2] = crc >> 8;
+
+    HardwareSerial& port = mbSlaveEQ->Serial;
+    if (serialRS485Auto())
+    {
+        port.write(response, pduLength + 3);        // The UART releases the bus after the last bit, no need to wait here
+        return;
+    }
+    modbusSetTransmit(mbSlaveEQ, true, mbSlaveBaud);
+    port.write(response, pduLength + 3);
+    port.flush();
+    modbusSetTransmit(mbSlaveEQ, false, mbSlaveBaud);
+}
+
+static void modbusSlaveTask(void* arg)
+{
+    HardwareSerial& port = mbSlaveEQ->Serial;
+    UBaseType_t basePriority = uxTaskPriorityGet(NULL);
+    bool fast = false;
+
+    while (mbSlaveRunning.load(std::memory_order_acquire))
+    {
+        // Only the automatic direction reply path is short and non-blocking enough to run above lwIP. With manual
+        // direction every reply reconfigures the port twice and waits for the transmission, so it stays at the base
+        // priority, which configTaskPriority() may have changed in the meantime.
+        bool autoDirection = serialRS485Auto();
+        if (autoDirection != fast)
+        {
+            if (autoDirection)
+            {
+                basePriority = uxTaskPriorityGet(NULL);
+                vTaskPrioritySet(NULL, MODBUS_SLAVE_FAST_PRIORITY);
+            }
+            else
+                vTaskPrioritySet(NULL, basePriority);
+            fast = autoDirection;
+        }
+
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MODBUS_SLAVE_IDLE_MS)) == 0)
+            continue;
+
+        uint8_t frame[MODBUS_MAX_ADU];
+        size_t length = 0;
+        bool overflow = false;
+        while (port.available())
+        {
+            int b = port.read();
+            if (length < sizeof(frame))
+                frame[length++] = b;
+            else
+                overflow = true;
+        }
+
+        if (!overflow)
+            modbusSlaveHandleFrame(frame, length);
+    }
+
+    mbSlaveTaskHandle = NULL;
+    vTaskDelete(NULL);
+}
+
+bool EQSP32::startModbusSlave(uint8_t address, int baud)
+{
+    if (address < 1 || address > 247 || baud <= 0)
+        return false;
+    if (mbSlaveRunning.load(std::memory_order_acquire))
+        stopModbusSlave();
+
+    if (!serialClaimPort())
+        return false;
+    if (!modbusServerStart(this))
+    {
+        serialReleasePort();
+        return false;
+    }
+
+    mbSlaveEQ = this;
+    mbSlaveAddress = address;
+    mbSlaveBaud = baud;
+    modbusConfigSerial(this, baud);
+    mbSlaveRunning.store(true, std::memory_order_release);
+
+    if (xTaskCreatePinnedToCore(modbusSlaveTask, "EQSP32_MbSlave", MODBUS_SLAVE_TASK_STACK, NULL,
+                                MODBUS_SLAVE_TASK_PRIORITY, &mbSlaveTaskHandle, tskNO_AFFINITY) != pdPASS)
+    {
+        mbSlaveRunning.store(false, std::memory_order_release);
+        modbusServerStop();
+        serialReleasePort();
+        return false;
+    }
+
+    Serial.setRxTimeout(MODBUS_SLAVE_RX_TIMEOUT);
+    Serial.onReceive(modbusSlaveOnReceive, true);
+    return true;
+}
+
+void EQSP32::stopModbusSlave()
+{
+    if (!mbSlaveRunning.exchange(false))
+        return;
+
+    Serial.onReceive(NULL);
+    while (mbSlaveTaskHandle != NULL)
+        vTaskDelay(pdMS_TO_TICKS(1));
+
+    modbusServerStop();
+    serialReleasePort();
+}
@@ -0,0 +1,174 @@
+#include "Modbus_Handling.h"
+#include "Task_Handling.h"
+
+#include <WiFi.h>
+#include <atomic>
+
+#define MODBUS_TCP_TASK_STACK       4096
+#define MODBUS_TCP_TASK_PRIORITY    TASK_PRIORITY_PROTOCOL
+#define MODBUS_TCP_MAX_CLIENTS      4
+#define MODBUS_TCP_IDLE_TIMEOUT_MS  60000   // Connections without requests are closed to free their slot
+#define MODBUS_TCP_MBAP_SIZE        7       // Transaction ID, protocol ID, length, unit ID
+
+
+/*  ***********************************************
+     ---   ---   ---   ---   ---   ---   ---   ---
+    Modbus TCP server
+     ---   ---   ---   ---   ---   ---   ---   ---
+    ***********************************************   */
+typedef struct {
+    WiFiClient client;
+    bool used;
+    size_t fill;
+    uint32_t lastActivity;
+    uint8_t frame[MODBUS_TCP_MBAP_SIZE + MODBUS_MAX_PDU];
+} ModbusTcpClient;
+
+static WiFiServer* mbTcpServer = nullptr;
+static ModbusTcpClient mbTcpClients[MODBUS_TCP_MAX_CLIENTS];
+
+static std::atomic<bool> mbTcpRunning(false);
+static TaskHandle_t mbTcpTaskHandle = NULL;
+
+static void modbusTcpClose(ModbusTcpClient& slot)
+{
+    slot.client.stop();
+    slot.used = false;
+}
+
+static void modbusTcpAccept()
+{
+    while (mbTcpServer->hasClient())
+    {
+        WiFiClient client = mbTcpServer->available();
+        int slot = -1;
+        for (int i = 0; i < MODBUS_TCP_MAX_CLIENTS && slot < 0; i++)
+            if (!mbTcpClients[i].used)
+                slot = i;
+
+        if (slot < 0)
+        {
+            client.stop();
+            continue;
+        }
+
+        client.setNoDelay(true);
+        mbTcpClients[slot].client = client;
+        mbTcpClients[slot].used = true;
+        mbTcpClients[slot].fill = 0;
+        mbTcpClients[slot].lastActivity = millis();
+    }
+}
+
+// Serves at most one request per call, so a flooding client shares the task with the others
+static void modbusTcpService(ModbusTcpClient& slot)
+{
+    uint8_t* frame = slot.frame;
+
+    while (true)
+    {
+        size_t needed = MODBUS_TCP_MBAP_SIZE;
+        if (slot.fill >= 6)
+        {
+            uint16_t length = (frame[4] << 8) | frame[5];       // Unit ID and PDU
+            if (frame[2] != 0 || frame[3] != 0 || length < 2 || length > MODBUS_MAX_PDU + 1)
+            {
+                modbusTcpClose(slot);       // Not Modbus, the stream cannot be resynchronised
+                return;
+            }
+            needed = 6 + length;
+        }
+
+        if (slot.fill < needed)
+        {
+            int n = slot.client.read(&frame[slot.fill], needed - slot.fill);
+            if (n <= 0)
+                return;
+            slot.fill += n;
+            slot.lastActivity = millis();
+            continue;
+        }
+
+        // Response reuses the request header, only the length changes
+        uint8_t response[MODBUS_TCP_MBAP_SIZE + MODBUS_MAX_PDU];
+        size_t pduLength = modbusServePdu(&frame[MODBUS_TCP_MBAP_SIZE], needed - MODBUS_TCP_MBAP_SIZE, &response[MODBUS_TCP_MBAP_SIZE]);
+        memcpy(response, frame, MODBUS_TCP_MBAP_SIZE);
+        response[4] = (pduLength + 1) >> 8;
+        response[5] = (pduLength + 1) & 0xFF;
+        slot.client.write(response, MODBUS_TCP_MBAP_SIZE + pduLength);
+        slot.fill = 0;
+        return;
+    }
+}
+
+static void modbusTcpTask(void* arg)
+{
+    while (mbTcpRunning.load(std::memory_order_acquire))
+    {
+        modbusTcpAccept();
+
+        uint32_t now = millis();
+        for (int i = 0; i < MODBUS_TCP_MAX_CLIENTS; i++)
+        {
+            ModbusTcpClient& slot = mbTcpClients[i];
+            if (!slot.used)
+                continue;
+
+            if (!slot.client.connected() || now - slot.lastActivity > MODBUS_TCP_IDLE_TIMEOUT_MS)
+            {
+                modbusTcpClose(slot);
+                continue;
+            }
+            modbusTcpService(slot);
+        }
+
+        // Always yield, a client sending continuously must not starve lwIP, loop() or the scan task
+        vTaskDelay(1);
+    }
+
+    for (int i = 0; i < MODBUS_TCP_MAX_CLIENTS; i++)
+        if (mbTcpClients[i].used)
+            modbusTcpClose(mbTcpClients[i]);
+
+    mbTcpTaskHandle = NULL;
+    vTaskDelete(NULL);
+}
+
+bool EQSP32::startModbusTCP(uint16_t port)
+{
+    if (mbTcpRunning.load(std::memory_order_acquire))
+        stopModbusTCP();
+
+    if (!modbusServerStart(this))
+        return false;
+
+    mbTcpServer = new WiFiServer(port, MODBUS_TCP_MAX_CLIENTS);
+    mbTcpServer->begin();
+    mbTcpRunning.store(true, std::memory_order_release);
+
+    if (xTaskCreatePinnedToCore(modbusTcpTask, "EQSP32_MbTcp", MODBUS_TCP_TASK_STACK, NULL,
+                                MODBUS_TCP_TASK_PRIORITY, &mbTcpTaskHandle, tskNO_AFFINITY) != pdPASS)
+    {
+        mbTcpRunning.store(false, std::memory_order_release);
+        mbTcpServer->end();
+        delete mbTcpServer;
+        mbTcpServer = nullptr;
+        modbusServerStop();
+        return false;
+    }
+    return true;
+}
+
+void EQSP32::stopModbusTCP()
+{
+    if (!mbTcpRunning.exchange(false))
+        return;
+
+    while (mbTcpTaskHandle != NULL)
+        vTaskDelay(pdMS_TO_TICKS(1));
+
+    mbTcpServer->end();
+    delete mbTcpServer;
+    mbTcpServer = nullptr;
+    modbusServerStop();
+}
@@ -0,0 +1,245 @@
+#include "NVS_Handling.h"
+
+#include <Preferences.h>
+#include <esp_system.h>
+#include <atomic>
+#include <vector>
+
+#define NVS_CACHE_TASK_STACK        4096
+#define NVS_CACHE_TASK_PRIORITY     1
+
+
+/*  ***********************************************
+     ---   ---   ---   ---   ---   ---   ---   ---
+    NVS write-back cache
+     ---   ---   ---   ---   ---   ---   ---   ---
+    ***********************************************   */
+typedef struct {
+    std::string nameSpace;
+    std::string key;
+    std::vector<uint8_t> value;         // Current value, empty when removed
+    std::vector<uint8_t> stored;        // Value in flash, empty when missing
+    bool exists;                        // Current value is set
+    bool storedExists;
+    bool dirty;
+} NvsCacheEntry;
+
+static std::vector<NvsCacheEntry> nvsCacheEntries;
+static SettingsCacheStats nvsCacheStats;
+static int64_t nvsCacheFirstPending_us = 0;
+static int64_t nvsCacheLastChange_us = 0;
+
+static SemaphoreHandle_t nvsCacheMutex = NULL;
+static std::atomic<int> nvsCacheState(0);       // 0: not started, 1: starting, 2: ready
+
+// Must be called with nvsCacheMutex held. Loads the flash value the first time a key is used.
+static NvsCacheEntry& nvsCacheEntry(const char* nameSpace, const char* key)
+{
+    for (NvsCacheEntry& entry : nvsCacheEntries)
+        if (entry.key == key && entry.nameSpace == nameSpace)
+            return entry;
+
+    NvsCacheEntry entry;
+    entry.nameSpace = nameSpace;
+    entry.key = key;
+    entry.storedExists = false;
+
+    Preferences prefs;
+    if (prefs.begin(nameSpace, true))
+    {
+        size_t length = prefs.getBytesLength(key);
+        if (length > 0)
+        {
+            entry.stored.resize(length);
+            entry.storedExists = prefs.getBytes(key, entry.stored.data(), length) == length;
+        }
+        prefs.end();
+    }
+    if (!entry.storedExists)
+        entry.stored.clear();
+
+    entry.value = entry.stored;
+    entry.exists = entry.storedExists;
+    entry.dirty = false;
+    nvsCacheEntries.push_back(entry);
+    return nvsCacheEntries.back();
+}
+
+// Must be called with nvsCacheMutex held
+static void nvsCacheSet(NvsCacheEntry& entry, const void* data, size_t length, bool exists)
+{
+    nvsCacheStats.updates++;
+    if (entry.exists == exists && entry.value.size() == length && (length == 0 || memcmp(entry.value.data(), data, length) == 0))
+    {
+        nvsCacheStats.unchanged++;
+        return;
+    }
+    if (entry.dirty)
+        nvsCacheStats.coalesced++;
+
+    entry.value.assign((const uint8_t*)data, (const uint8_t*)data + length);
+    entry.exists = exists;
+    entry.dirty = entry.exists != entry.storedExists || entry.value != entry.stored;     // Reverted before the commit
+
+    int64_t now_us = esp_timer_get_time();
+    if (nvsCacheFirstPending_us == 0)
+        nvsCacheFirstPending_us = now_us;
+    nvsCacheLastChange_us = now_us;
+}
+
+// Must be called with nvsCacheMutex held
+static uint32_t nvsCachePending()
+{
+    uint32_t pending = 0;
+    for (const NvsCacheEntry& entry : nvsCacheEntries)
+        if (entry.dirty)
+            pending++;
+    return pending;
+}
+
+// Must be called with nvsCacheMutex held
+static void nvsCacheCommit()
+{
+    for (size_t i = 0; i < nvsCacheEntries.size(); i++)
+    {
+        if (!nvsCacheEntries[i].dirty)
+            continue;
+
+        // One open per namespace for all its pending keys
+        Preferences prefs;
+        if (!prefs.begin(nvsCacheEntries[i].nameSpace.c_str(), false))
+            continue;
+
+        for (size_t j = i; j < nvsCacheEntries.size(); j++)
+        {
+            NvsCacheEntry& entry = nvsCacheEntries[j];
+            if (!entry.dirty || entry.nameSpace != nvsCacheEntries[i].nameSpace)
+                continue;
+
+            bool written = entry.exists ? prefs.putBytes(entry.key.c_str(), entry.value.data(), entry.value.size()) == entry.value.size()
+                                        : prefs.remove(entry.key.c_str());
+            nvsCacheStats.flashWrites++;
+            if (written)
+            {
+                entry.stored = entry.value;
+                entry.storedExists = entry.exists;
+                entry.dirty = false;
+            }
+        }
+        prefs.end();
+    }
+
+    nvsCacheStats.commits++;
+    if (nvsCachePending() == 0)
+        nvsCacheFirstPending_us = 0;
+    else
+        nvsCacheFirstPending_us = nvsCacheLastChange_us = esp_timer_get_time();    // Retry failed writes after the next quiet period
+}
+
+static void nvsCacheFlush()
+{
+    if (nvsCacheState.load() != 2)
+        return;
+
+    xSemaphoreTake(nvsCacheMutex, portMAX_DELAY);
+    if (nvsCacheFirstPending_us != 0)
+        nvsCacheCommit();
+    xSemaphoreGive(nvsCacheMutex);
+}
+
+static void nvsCacheTask(void* arg)
+{
+    while (true)
+    {
+        vTaskDelay(pdMS_TO_TICKS(NVS_CACHE_QUIET_MS / 5));
+
+        xSemaphoreTake(nvsCacheMutex, portMAX_DELAY);
+        int64_t now_us = esp_timer_get_time();
+        if (nvsCacheFirstPending_us != 0 && (now_us - nvsCacheLastChange_us >= NVS_CACHE_QUIET_MS * 1000LL ||
+                                             now_us - nvsCacheFirstPending_us >= NVS_CACHE_MAX_DELAY_MS * 1000LL))
+            nvsCacheCommit();
+        xSemaphoreGive(nvsCacheMutex);
+    }
+}
+
+static bool nvsCacheStart()
+{
+    int state = 0;
+    if (nvsCacheState.compare_exchange_strong(state, 1))
+    {
+        nvsCacheMutex = xSemaphoreCreateMutex();
+        if (nvsCacheMutex == NULL ||
+            xTaskCreatePinnedToCore(nvsCacheTask, "EQSP32_NvsCache", NVS_CACHE_TASK_STACK, NULL,
+                                    NVS_CACHE_TASK_PRIORITY, NULL, tskNO_AFFINITY) != pdPASS)
+        {
+            if (nvsCacheMutex != NULL)
+                vSemaphoreDelete(nvsCacheMutex);
+            nvsCacheMutex = NULL;
+            nvsCacheState.store(0);
+            return false;
+        }
+
+        esp_register_shutdown_handler(nvsCacheFlush);       // Pending values survive esp_restart()
+        nvsCacheState.store(2);
+    }
+
+    while (nvsCacheState.load() == 1)
+        vTaskDelay(1);
+    return nvsCacheState.load() == 2;
+}
+
+bool nvsCachePut(const char* nameSpace, const char* key, const void* data, size_t length)
+{
+    if (data == nullptr || length == 0 || !nvsCacheStart())
+        return false;
+
+    xSemaphoreTake(nvsCacheMutex, portMAX_DELAY);
+    nvsCacheSet(nvsCacheEntry(nameSpace, key), data, length, true);
+    xSemaphoreGive(nvsCacheMutex);
+    return true;
+}
+
+size_t nvsCacheGet(const char* nameSpace, const char* key, void* data, size_t length)
+{
+    if (!nvsCacheStart())
+        return 0;
+
+    xSemaphoreTake(nvsCacheMutex, portMAX_DELAY);
+    const NvsCacheEntry& entry = nvsCacheEntry(nameSpace, key);
+    size_t stored = entry.exists ? entry.value.size() : 0;
+    if (stored > 0)
+        memcpy(data, entry.value.data(), stored < length ? stored : length);
+    xSemaphoreGive(nvsCacheMutex);
+
+    return stored;
+}
+
+bool nvsCacheRemove(const char* nameSpace, const char* key)
+{
+    if (!nvsCacheStart())
+        return false;
+
+    xSemaphoreTake(nvsCacheMutex, portMAX_DELAY);
+    nvsCacheSet(nvsCacheEntry(nameSpace, key), nullptr, 0, false);
+    xSemaphoreGive(nvsCacheMutex);
+    return true;
+}
+
+void EQSP32::flushSettings()
+{
+    nvsCacheFlush();
+}
+
+SettingsCacheStats EQSP32::getSettingsCacheStats()
+{
+    SettingsCacheStats stats;
+    if (nvsCacheState.load() != 2)
+        return stats;
+
+    xSemaphoreTake(nvsCacheMutex, portMAX_DELAY);
+    stats = nvsCacheStats;
+    stats.pending = nvsCachePending();
+    xSemaphoreGive(nvsCacheMutex);
+
+    return stats;
+}
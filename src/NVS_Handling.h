@@ -0,0 +1,15 @@
+#ifndef NVS_Handling_h
+#define NVS_Handling_h
+
+#include "EQSP32.h"
+
+// Write-back cache in front of Preferences. Values are committed after NVS_CACHE_QUIET_MS without changes,
+// at the latest NVS_CACHE_MAX_DELAY_MS after the first pending change, on flushSettings() and before esp_restart().
+#define NVS_CACHE_QUIET_MS          5000
+#define NVS_CACHE_MAX_DELAY_MS      60000
+
+bool nvsCachePut(const char* nameSpace, const char* key, const void* data, size_t length);
+size_t nvsCacheGet(const char* nameSpace, const char* key, void* data, size_t length);     // Returns the stored length, 0 if missing
+bool nvsCacheRemove(const char* nameSpace, const char* key);
+
+#endif
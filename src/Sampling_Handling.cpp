@@ -0,0 +1,35 @@
+#include "Sampling_Handling.h"
+
+// User variable database of the library core, index 0 holds user variable 1
+extern bool localDatabaseUserBool[USER_NUM_BOOL];
+extern int localDatabaseUserInt[USER_NUM_INT];
+
+
+/*  ***********************************************
+     ---   ---   ---   ---   ---   ---   ---   ---
+    Edge-neutral sampling
+     ---   ---   ---   ---   ---   ---   ---   ---
+    ***********************************************   */
+bool userBoolSample(int idx)
+{
+    if (idx < 1 || idx > USER_NUM_BOOL)
+        return false;
+    return ((volatile bool*)localDatabaseUserBool)[idx - 1];
+}
+
+int userIntSample(int idx)
+{
+    if (idx < 1 || idx > USER_NUM_INT)
+        return 0;
+    return ((volatile int*)localDatabaseUserInt)[idx - 1];
+}
+
+bool pinSampleAnalog(EQSP32* eq, int pinIndex, int& value)
+{
+    PinMode mode = eq->readMode(pinIndex);
+    if (mode != AIN && mode != RAIN && mode != TIN)
+        return false;
+
+    value = eq->readPin(pinIndex);
+    return true;
+}
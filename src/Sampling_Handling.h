@@ -0,0 +1,15 @@
+#ifndef Sampling_Handling_h
+#define Sampling_Handling_h
+
+#include "EQSP32.h"
+
+// readUserBool() keeps the previous value of each index for its trigger modes and overwrites it on every call, STATE
+// included. Library tasks sample the user variables from the database directly, so edge reads in loop() stay intact.
+bool userBoolSample(int idx);
+int userIntSample(int idx);
+
+// readPin() ignores the trigger modes for analog inputs (AIN, RAIN, TIN), so those pins are sampled through it. There is
+// no such path for digital pins, their readPin() resets the edge state; returns false and leaves value untouched.
+bool pinSampleAnalog(EQSP32* eq, int pinIndex, int& value);
+
+#endif
@@ -0,0 +1,710 @@
+#include "EQSP32.h"
+#include "NVS_Handling.h"
+
+#include <atomic>
+
+#define SCHEDULER_TASK_STACK        4096
+#define SCHEDULER_TASK_PRIORITY     2
+#define SCHEDULER_PERIOD_MS         1000
+#define SCHEDULER_MAX_ENTRIES       32
+#define SCHEDULER_MAX_DURATION_S    (7 * 24 * 3600)
+#define SCHEDULER_TIME_JUMP_S       120             // Clock steps larger than this re-plan instead of catching up
+#define SCHEDULER_SEARCH_DAYS       (4 * 366 + 1)   // Covers schedules on February 29
+#define SCHEDULER_NVS_NAMESPACE     "eq_sched"
+#define SCHEDULER_NO_START          ((time_t)-1)    // Planned, no start within the search range
+
+
+/*  ***********************************************
+     ---   ---   ---   ---   ---   ---   ---   ---
+    Calendar scheduler
+     ---   ---   ---   ---   ---   ---   ---   ---
+    ***********************************************   */
+typedef struct {
+    uint64_t minutes;               // Bit n: minute n
+    uint32_t hours;                 // Bit n: hour n
+    uint32_t days;                  // Bit n: day of month n
+    uint16_t months;                // Bit n: month n
+    uint8_t weekDays;               // Bit n: EQTime::weekDay n
+    bool anyDay;                    // Day of month field is *
+    bool anyWeekDay;                // Day of week field is *
+} CronSpec;
+
+// Persisted part of a schedule
+typedef struct {
+    CronSpec spec;
+    uint32_t duration_s;
+    bool enabled;
+} ScheduleTiming;
+
+typedef struct {
+    bool used;
+    ScheduleTiming timing;
+    int pin;                        // 0 for callback schedules
+    int value;
+    EQScheduleCallback callback;
+    void* arg;
+
+    time_t nextStart;               // 0 until planned, SCHEDULER_NO_START if the schedule never starts
+    bool active;
+    time_t activeUntil;
+    int64_t activeEnd_us;           // Windows end on the monotonic clock, so clock steps do not stretch them
+
+    std::string configName;         // Empty if not linked to config entities
+    int configStart;                // Last config values applied, HHMM
+    int configDuration;             // Minutes
+    int configDays;
+    bool configEnable;
+} ScheduleEntry;
+
+typedef struct {
+    int id;
+    bool active;
+    int pin;                        // 0 if no pin is changed
+    int value;
+    EQScheduleCallback callback;
+    void* arg;
+} ScheduleAction;
+
+static ScheduleEntry schedEntries[SCHEDULER_MAX_ENTRIES];
+static EQSP32* schedEQ = nullptr;
+static SemaphoreHandle_t schedMutex = NULL;
+static std::atomic<int> schedState(0);          // 0: not started, 1: starting, 2: ready
+
+// Task state, only used by the scheduler task
+static bool schedSynced = false;
+static time_t schedLastNow = 0;
+static int64_t schedLastMono_us = 0;
+static std::string schedLastTz;
+
+static bool cronParseNumber(const char*& p, int& value)
+{
+    if (*p < '0' || *p > '9')
+        return false;
+
+    value = 0;
+    while (*p >= '0' && *p <= '9')
+    {
+        value = value * 10 + (*p++ - '0');
+        if (value > 99)
+            return false;
+    }
+    return true;
+}
+
+static bool cronParseField(const char*& p, int min, int max, uint64_t& mask, bool& any)
+{
+    const char* field = p;
+    mask = 0;
+
+    while (true)
+    {
+        int low, high, step = 1;
+        if (*p == '*')
+        {
+            low = min;
+            high = max;
+            p++;
+        }
+        else
+        {
+            if (!cronParseNumber(p, low))
+                return false;
+            high = low;
+            if (*p == '-')
+            {
+                p++;
+                if (!cronParseNumber(p, high))
+                    return false;
+            }
+            else if (*p == '/')
+                high = max;         // "a/n" runs from a to the end of the range
+        }
+
+        if (*p == '/')
+        {
+            p++;
+            if (!cronParseNumber(p, step) || step == 0)
+                return false;
+        }
+
+        if (low < min || high > max || low > high)
+            return false;
+        for (int v = low; v <= high; v += step)
+            mask |= 1ULL << v;
+
+        if (*p != ',')
+            break;
+        p++;
+    }
+
+    any = (p - field == 1 && *field == '*');
+    return *p == '\0' || *p == ' ' || *p == '\t';
+}
+
+static bool cronParse(const std::string& cron, CronSpec& spec)
+{
+    static const int limits[5][2] = { {0, 59}, {0, 23}, {1, 31}, {1, 12}, {0, 7} };
+    uint64_t masks[5];
+    bool any[5];
+
+    const char* p = cron.c_str();
+    for (int f = 0; f < 5; f++)
+    {
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (!cronParseField(p, limits[f][0], limits[f][1], masks[f], any[f]))
+            return false;
+    }
+    while (*p == ' ' || *p == '\t')
+        p++;
+    if (*p != '\0')
+        return false;
+
+    memset(&spec, 0, sizeof(spec));         // Persisted as bytes, keep the padding deterministic
+    spec.minutes = masks[0];
+    spec.hours = masks[1];
+    spec.days = masks[2];
+    spec.months = masks[3];
+    spec.weekDays = (masks[4] | (masks[4] >> 7)) & 0x7F;     // 7 is also Sunday
+    spec.anyDay = any[2];
+    spec.anyWeekDay = any[4];
+    return true;
+}
+
+static void cronWeekly(CronSpec& spec, uint8_t days, int hour, int mins)
+{
+    memset(&spec, 0, sizeof(spec));
+    spec.minutes = 1ULL << mins;
+    spec.hours = 1u << hour;
+    spec.days = 0xFFFFFFFE;
+    spec.months = 0x1FFE;
+    spec.weekDays = days & 0x7F;
+    spec.anyDay = true;
+}
+
+static bool cronMatchesDay(const CronSpec& spec, int mday, int month, int weekDay)
+{
+    if (!(spec.months & (1u << month)))
+        return false;
+
+    bool dayMatch = spec.days & (1u << mday);
+    bool weekDayMatch = spec.weekDays & (1u << weekDay);
+    if (spec.anyDay)
+        return weekDayMatch;
+    if (spec.anyWeekDay)
+        return dayMatch;
+    return dayMatch || weekDayMatch;        // Both restricted, cron matches either
+}
+
+// False if no date matches, e.g. "0 0 30 2 *", so the schedule would never start
+static bool cronCanMatch(const CronSpec& spec)
+{
+    static const int monthDays[13] = { 0, 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+    if (spec.minutes == 0 || spec.hours == 0 || spec.months == 0)
+        return false;
+    if (spec.anyDay)
+        return spec.weekDays != 0;          // Matched by week day only
+    if (!spec.anyWeekDay && spec.weekDays != 0)
+        return true;                        // Every month has each week day
+
+    for (int month = 1; month <= 12; month++)
+        if ((spec.months & (1u << month)) && (spec.days & ((2u << monthDays[month]) - 2)))
+            return true;
+    return false;
+}
+
+static int64_t wallClockKey(const struct tm& t)
+{
+    return ((((int64_t)t.tm_year * 12 + t.tm_mon) * 32 + t.tm_mday) * 24 + t.tm_hour) * 60 + t.tm_min;
+}
+
+// Converts a local wall clock minute to Unix time. A minute skipped by a DST change maps to the instant the clock resumes.
+static time_t localToTime(const struct tm& day, int hour, int mins)
+{
+    struct tm wall = {};
+    wall.tm_year = day.tm_year;
+    wall.tm_mon = day.tm_mon;
+    wall.tm_mday = day.tm_mday;
+    wall.tm_hour = hour;
+    wall.tm_min = mins;
+    wall.tm_isdst = -1;
+    int64_t key = wallClockKey(wall);
+
+    struct tm check = wall;
+    time_t t = mktime(&check);
+    localtime_r(&t, &check);
+    if (wallClockKey(check) == key)
+        return t;
+
+    // Inside a DST gap, find the first instant whose wall clock is past the requested minute
+    time_t low = t - 2 * 3600, high = t + 2 * 3600;
+    localtime_r(&low, &check);
+    if (wallClockKey(check) >= key)
+        return t;
+    while (high - low > 1)
+    {
+        time_t mid = low + (high - low) / 2;
+        localtime_r(&mid, &check);
+        if (wallClockKey(check) >= key)
+            high = mid;
+        else
+            low = mid;
+    }
+    return high;
+}
+
+// First schedule start strictly after `after`, 0 if there is none within the search range
+static time_t cronNext(const CronSpec& spec, time_t after)
+{
+    struct tm from;
+    localtime_r(&after, &from);
+
+    for (int dayOffset = 0; dayOffset < SCHEDULER_SEARCH_DAYS; dayOffset++)
+    {
+        struct tm day = {};
+        day.tm_year = from.tm_year;
+        day.tm_mon = from.tm_mon;
+        day.tm_mday = from.tm_mday + dayOffset;
+        day.tm_hour = 12;               // Normalise the date away from DST changes
+        day.tm_isdst = -1;
+        if (mktime(&day) == (time_t)-1)
+            return 0;
+        if (!cronMatchesDay(spec, day.tm_mday, day.tm_mon + 1, day.tm_wday))
+            continue;
+
+        for (int hour = dayOffset == 0 ? from.tm_hour : 0; hour < 24; hour++)
+        {
+            if (!(spec.hours & (1u << hour)))
+                continue;
+
+            int firstMin = (dayOffset == 0 && hour == from.tm_hour) ? from.tm_min + 1 : 0;
+            for (int mins = firstMin; mins < 60; mins++)
+            {
+                if (!(spec.minutes & (1ULL << mins)))
+                    continue;
+
+                // A repeated DST hour gives an earlier instant, the start already happened
+                time_t t = localToTime(day, hour, mins);
+                if (t > after)
+                    return t;
+            }
+        }
+    }
+    return 0;
+}
+
+static bool schedLock()
+{
+    return schedMutex != NULL && xSemaphoreTake(schedMutex, portMAX_DELAY) == pdTRUE;
+}
+
+static void schedUnlock()
+{
+    xSemaphoreGive(schedMutex);
+}
+
+// Must be called with schedMutex held
+static void schedEndWindow(int id, ScheduleAction* actions, int& count)
+{
+    ScheduleEntry& entry = schedEntries[id];
+    if (!entry.active)
+        return;
+
+    entry.active = false;
+    entry.activeUntil = 0;
+
+    // Another schedule may still hold the same pin
+    int pin = entry.pin;
+    for (int i = 0; i < SCHEDULER_MAX_ENTRIES && pin != 0; i++)
+        if (i != id && schedEntries[i].used && schedEntries[i].active && schedEntries[i].pin == pin)
+            pin = 0;
+
+    if (pin == 0 && entry.callback == nullptr)
+        return;
+    actions[count++] = { id, false, pin, 0, entry.callback, entry.arg };
+}
+
+// Must be called with schedMutex held
+static void schedStartWindow(int id, time_t start, time_t now, int64_t now_us, ScheduleAction* actions, int& count)
+{
+    ScheduleEntry& entry = schedEntries[id];
+    uint32_t duration_s = entry.timing.duration_s;
+
+    if (duration_s > 0)
+    {
+        entry.activeUntil = start + duration_s;
+        entry.activeEnd_us = now_us + (int64_t)(entry.activeUntil - now) * 1000000;
+        if (entry.active)
+            return;         // Overlapping windows extend the current one
+        entry.active = true;
+    }
+    actions[count++] = { id, true, entry.pin, entry.value, entry.callback, entry.arg };
+}
+
+// Must be called with schedMutex held. A window already in progress is entered for its remaining time.
+static void schedPlan(int id, time_t now, int64_t now_us, ScheduleAction* actions, int& count)
+{
+    ScheduleEntry& entry = schedEntries[id];
+    uint32_t duration_s = entry.timing.duration_s;
+
+    time_t start = cronNext(entry.timing.spec, duration_s > 0 ? now - duration_s : now - 1);
+    if (start != 0 && start <= now)
+    {
+        schedStartWindow(id, start, now, now_us, actions, count);
+        start = cronNext(entry.timing.spec, start);
+    }
+    entry.nextStart = start != 0 ? start : SCHEDULER_NO_START;      // Not searched again until re-planned
+}
+
+static void schedApply(const ScheduleAction* actions, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (actions[i].pin != 0)
+            schedEQ->pinValue(actions[i].pin, actions[i].value);
+        if (actions[i].callback != nullptr)
+            actions[i].callback(actions[i].id, actions[i].active, actions[i].arg);
+    }
+}
+
+static void schedConfigPublish(ScheduleEntry& entry)
+{
+    const CronSpec& spec = entry.timing.spec;
+    int hour = spec.hours ? __builtin_ctz(spec.hours) : 0;
+    int mins = spec.minutes ? __builtin_ctzll(spec.minutes) : 0;
+
+    entry.configStart = hour * 100 + mins;
+    entry.configDuration = entry.timing.duration_s / 60;
+    entry.configDays = spec.anyWeekDay ? SCHEDULE_EVERY_DAY : spec.weekDays;
+    entry.configEnable = entry.timing.enabled;
+
+    updateConfig_Value(entry.configName + " Start", entry.configStart);
+    updateConfig_Value(entry.configName + " Duration", entry.configDuration);
+    updateConfig_Value(entry.configName + " Days", entry.configDays);
+    updateConfig_Switch(entry.configName + " Enable", entry.configEnable);
+}
+
+// Must be called with schedMutex held. Returns true if the schedule was changed.
+static bool schedConfigPoll(int id, ScheduleAction* actions, int& count)
+{
+    ScheduleEntry& entry = schedEntries[id];
+    int start = (int)readConfig_Value(entry.configName + " Start");
+    int duration = (int)readConfig_Value(entry.configName + " Duration");
+    int days = (int)readConfig_Value(entry.configName + " Days");
+    bool enable = readConfig_Switch(entry.configName + " Enable");
+
+    if (start == entry.configStart && duration == entry.configDuration && days == entry.configDays && enable == entry.configEnable)
+        return false;
+    if (start < 0 || start / 100 > 23 || start % 100 > 59 || duration < 0 || duration * 60 > SCHEDULER_MAX_DURATION_S || days < 1 || days > SCHEDULE_EVERY_DAY)
+    {
+        schedConfigPublish(entry);      // Snap the entities back to the timing in use, so the UI does not show a rejected edit
+        return false;
+    }
+
+    entry.configStart = start;
+    entry.configDuration = duration;
+    entry.configDays = days;
+    entry.configEnable = enable;
+
+    schedEndWindow(id, actions, count);
+    cronWeekly(entry.timing.spec, days, start / 100, start % 100);
+    entry.timing.duration_s = duration * 60;
+    entry.timing.enabled = enable;
+    entry.nextStart = 0;
+    return true;
+}
+
+static void schedulerTask(void* arg)
+{
+    TickType_t lastWake = xTaskGetTickCount();
+    ScheduleAction actions[2 * SCHEDULER_MAX_ENTRIES];
+
+    while (true)
+    {
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(SCHEDULER_PERIOD_MS));
+
+        EQTime local;
+        bool synced = schedEQ->getLocalTime(local);
+        time_t now = local.unixTime;
+        int64_t now_us = esp_timer_get_time();
+
+        // Re-plan after a sync, a clock step or a timezone change, instead of firing every start in between
+        const char* tz = getenv("TZ");
+        int64_t drift = (int64_t)now - schedLastNow - (now_us - schedLastMono_us) / 1000000;
+        bool replan = (synced && !schedSynced) || drift > SCHEDULER_TIME_JUMP_S || drift < -SCHEDULER_TIME_JUMP_S ||
+                      schedLastTz != (tz != nullptr ? tz : "");
+        schedSynced = synced;
+        schedLastNow = now;
+        schedLastMono_us = now_us;
+        schedLastTz = tz != nullptr ? tz : "";
+
+        int count = 0;
+        bool configChanged = false;
+        schedLock();
+        for (int id = 0; id < SCHEDULER_MAX_ENTRIES; id++)
+        {
+            ScheduleEntry& entry = schedEntries[id];
+            if (!entry.used)
+                continue;
+
+            if (!entry.configName.empty())
+                configChanged |= schedConfigPoll(id, actions, count);
+
+            if (entry.active && now_us >= entry.activeEnd_us)
+                schedEndWindow(id, actions, count);
+
+            if (!entry.timing.enabled || !synced)
+            {
+                entry.nextStart = 0;
+                continue;
+            }
+
+            if (replan || entry.nextStart == 0)
+                schedPlan(id, now, now_us, actions, count);
+            else if (entry.nextStart != SCHEDULER_NO_START && now >= entry.nextStart)
+            {
+                schedStartWindow(id, entry.nextStart, now, now_us, actions, count);
+                time_t next = cronNext(entry.timing.spec, entry.nextStart);
+                entry.nextStart = next != 0 ? next : SCHEDULER_NO_START;
+            }
+        }
+        schedUnlock();
+
+        schedApply(actions, count);
+        if (configChanged)
+            schedEQ->saveSchedules();
+    }
+}
+
+static bool schedulerStart(EQSP32* eq)
+{
+    int state = 0;
+    if (schedState.compare_exchange_strong(state, 1))
+    {
+        schedMutex = xSemaphoreCreateMutex();
+        if (schedMutex == NULL)
+        {
+            schedState.store(0);
+            return false;
+        }
+
+        schedEQ = eq;
+        xTaskCreatePinnedToCore(schedulerTask, "EQSP32_Sched", SCHEDULER_TASK_STACK, NULL,
+                                SCHEDULER_TASK_PRIORITY, NULL, tskNO_AFFINITY);
+        schedState.store(2);
+    }
+
+    while (schedState.load() == 1)
+        vTaskDelay(1);
+    return schedState.load() == 2;
+}
+
+static int schedAdd(EQSP32* eq, const CronSpec& spec, uint32_t duration_s, int pin, int value, EQScheduleCallback callback, void* arg)
+{
+    if (duration_s > SCHEDULER_MAX_DURATION_S || !cronCanMatch(spec) || !schedulerStart(eq))
+        return -1;
+
+    int id = -1;
+    schedLock();
+    for (int i = 0; i < SCHEDULER_MAX_ENTRIES && id < 0; i++)
+    {
+        if (schedEntries[i].used)
+            continue;
+
+        id = i;
+        ScheduleEntry& entry = schedEntries[i];
+        memset(&entry.timing, 0, sizeof(entry.timing));
+        entry.timing.spec = spec;
+        entry.timing.duration_s = duration_s;
+        entry.timing.enabled = true;
+        entry.pin = pin;
+        entry.value = value;
+        entry.callback = callback;
+        entry.arg = arg;
+        entry.nextStart = 0;            // Planned by the scheduler task
+        entry.active = false;
+        entry.activeUntil = 0;
+        entry.configName.clear();
+        entry.used = true;
+    }
+    schedUnlock();
+
+    return id;
+}
+
+int EQSP32::addSchedule(const std::string& cron, uint32_t duration_s, int pin, int value)
+{
+    CronSpec spec;
+    if (pin == 0 || !cronParse(cron, spec))
+        return -1;
+    return schedAdd(this, spec, duration_s, pin, value, nullptr, nullptr);
+}
+
+int EQSP32::addSchedule(const std::string& cron, uint32_t duration_s, EQScheduleCallback callback, void* arg)
+{
+    CronSpec spec;
+    if (callback == nullptr || !cronParse(cron, spec))
+        return -1;
+    return schedAdd(this, spec, duration_s, 0, 0, callback, arg);
+}
+
+int EQSP32::addWeeklySchedule(uint8_t days, int hour, int mins, uint32_t duration_s, int pin, int value)
+{
+    if (pin == 0 || days == 0 || hour < 0 || hour > 23 || mins < 0 || mins > 59)
+        return -1;
+
+    CronSpec spec;
+    cronWeekly(spec, days, hour, mins);
+    return schedAdd(this, spec, duration_s, pin, value, nullptr, nullptr);
+}
+
+bool EQSP32::removeSchedule(int id)
+{
+    if (id < 0 || id >= SCHEDULER_MAX_ENTRIES || !schedLock())
+        return false;
+
+    ScheduleAction actions[1];
+    int count = 0;
+    bool removed = schedEntries[id].used;
+    if (removed)
+    {
+        schedEndWindow(id, actions, count);
+        schedEntries[id].used = false;
+    }
+    schedUnlock();
+
+    schedApply(actions, count);
+    return removed;
+}
+
+void EQSP32::clearSchedules()
+{
+    for (int id = 0; id < SCHEDULER_MAX_ENTRIES; id++)
+        removeSchedule(id);
+}
+
+bool EQSP32::enableSchedule(int id, bool enable)
+{
+    if (id < 0 || id >= SCHEDULER_MAX_ENTRIES || !schedLock())
+        return false;
+
+    ScheduleAction actions[1];
+    int count = 0;
+    ScheduleEntry& entry = schedEntries[id];
+    bool found = entry.used;
+    if (found && entry.timing.enabled != enable)
+    {
+        if (!enable)
+            schedEndWindow(id, actions, count);
+        entry.timing.enabled = enable;
+        entry.nextStart = 0;
+    }
+    schedUnlock();
+
+    schedApply(actions, count);
+    return found;
+}
+
+bool EQSP32::getScheduleStatus(int id, EQScheduleStatus& status)
+{
+    if (id < 0 || id >= SCHEDULER_MAX_ENTRIES || !schedLock())
+        return false;
+
+    const ScheduleEntry& entry = schedEntries[id];
+    bool found = entry.used;
+    if (found)
+    {
+        status.enabled = entry.timing.enabled;
+        status.active = entry.active;
+        status.nextStart = entry.nextStart != SCHEDULER_NO_START ? entry.nextStart : 0;
+        status.activeUntil = entry.activeUntil;
+    }
+    schedUnlock();
+
+    return found;
+}
+
+bool EQSP32::saveSchedules()
+{
+    if (!schedLock())
+        return false;
+
+    ScheduleTiming timings[SCHEDULER_MAX_ENTRIES];
+    bool used[SCHEDULER_MAX_ENTRIES];
+    for (int id = 0; id < SCHEDULER_MAX_ENTRIES; id++)
+    {
+        used[id] = schedEntries[id].used;
+        timings[id] = schedEntries[id].timing;
+    }
+    schedUnlock();
+
+    // The settings cache skips unchanged schedules and batches the flash commit
+    bool ok = true;
+    for (int id = 0; id < SCHEDULER_MAX_ENTRIES; id++)
+    {
+        char key[8];
+        snprintf(key, sizeof(key), "t%d", id);
+
+        if (used[id])
+            ok &= nvsCachePut(SCHEDULER_NVS_NAMESPACE, key, &timings[id], sizeof(timings[id]));
+        else
+            ok &= nvsCacheRemove(SCHEDULER_NVS_NAMESPACE, key);
+    }
+
+    return ok;
+}
+
+bool EQSP32::loadSchedules()
+{
+    if (!schedLock())
+        return false;
+
+    ScheduleAction actions[SCHEDULER_MAX_ENTRIES];
+    int count = 0;
+    bool found = false;
+    for (int id = 0; id < SCHEDULER_MAX_ENTRIES; id++)
+    {
+        ScheduleEntry& entry = schedEntries[id];
+        char key[8];
+        snprintf(key, sizeof(key), "t%d", id);
+
+        ScheduleTiming stored;
+        if (!entry.used || nvsCacheGet(SCHEDULER_NVS_NAMESPACE, key, &stored, sizeof(stored)) != sizeof(stored) ||
+            !cronCanMatch(stored.spec))
+            continue;
+
+        schedEndWindow(id, actions, count);
+        entry.timing = stored;
+        entry.nextStart = 0;
+        if (!entry.configName.empty())
+            schedConfigPublish(entry);
+        found = true;
+    }
+    schedUnlock();
+
+    schedApply(actions, count);
+    return found;
+}
+
+bool EQSP32::linkScheduleConfig(int id, const std::string& name)
+{
+    if (id < 0 || id >= SCHEDULER_MAX_ENTRIES || name.empty() || !schedLock())
+        return false;
+
+    ScheduleEntry& entry = schedEntries[id];
+    bool found = entry.used;
+    if (found)
+    {
+        createConfig_Value(name + " Start", 0, 2359, 0);
+        createConfig_Value(name + " Duration", 0, SCHEDULER_MAX_DURATION_S / 60, 0);
+        createConfig_Value(name + " Days", 1, SCHEDULE_EVERY_DAY, 0);
+        createConfig_Switch(name + " Enable");
+
+        entry.configName = name;
+        schedConfigPublish(entry);
+    }
+    schedUnlock();
+
+    return found;
+}
@@ -0,0 +1,474 @@
+#include "Serial_Handling.h"
+#include "Memory_Handling.h"
+
+#include "driver/uart.h"
+#include <atomic>
+
+#define SERIAL_CHANNEL_RX_BUFFER    4096    // UART driver ring buffers, replace the default 256 bytes
+#define SERIAL_CHANNEL_TX_BUFFER    4096
+#define SERIAL_CHANNEL_RX_TIMEOUT   3       // Characters of silence that end a frame in idle line framing
+#define SERIAL_CHANNEL_CHUNK        128     // Bytes moved from the driver to the decoder per read
+
+#define SLIP_END                    0xC0
+#define SLIP_ESC                    0xDB
+#define SLIP_ESC_END                0xDC
+#define SLIP_ESC_ESC                0xDD
+
+static std::atomic<bool> serialPortClaimed(false);
+
+bool serialClaimPort()
+{
+    return !serialPortClaimed.exchange(true);
+}
+
+void serialReleasePort()
+{
+    serialPortClaimed.store(false);
+}
+
+
+/*  ***********************************************
+     ---   ---   ---   ---   ---   ---   ---   ---
+    RS485 automatic direction control
+     ---   ---   ---   ---   ---   ---   ---   ---
+    ***********************************************   */
+static std::atomic<bool> rs485Auto(false);
+static bool rs485AutoInvert = false;
+
+bool serialRS485Auto()
+{
+    return rs485Auto.load();
+}
+
+bool serialRS485AutoInvert()
+{
+    return rs485AutoInvert;
+}
+
+// Hands the enable pin over to the UART RTS output of an already started port
+static bool serialEnableRS485Auto(EQSP32* eq, bool invertEnable)
+{
+    return eq->Serial.setPins(eq->getPin(EQ_RS485_RX), eq->getPin(EQ_RS485_TX), -1, eq->getPin(EQ_RS485_EN)) &&
+           eq->Serial.setMode(UART_MODE_RS485_HALF_DUPLEX) &&
+           uart_set_line_inverse(EQ_SERIAL_UART_NUM, invertEnable ? UART_SIGNAL_RTS_INV : 0) == ESP_OK;
+}
+
+bool EQSP32::configRS485Auto(int baud, bool invertEnable)
+{
+    // Pins and baud rate through the regular path first
+    if (!configSerial(RS485_RX, baud))
+        return false;
+
+    if (!serialEnableRS485Auto(this, invertEnable))
+    {
+        configSerial(RS485_RX, baud);
+        return false;
+    }
+
+    rs485AutoInvert = invertEnable;
+    rs485Auto.store(true);
+    return true;
+}
+
+void EQSP32::disableRS485Auto()
+{
+    if (!rs485Auto.exchange(false))
+        return;
+
+    Serial.setMode(UART_MODE_UART);
+    uart_set_line_inverse(EQ_SERIAL_UART_NUM, 0);
+    configSerial(RS485_RX, Serial.baudRate());          // Takes the enable pin back from the UART
+    rs485AutoInvert = false;
+}
+
+bool EQSP32::readRS485Collision()
+{
+    bool collision = false;
+
+    if (rs485Auto.load())
+        uart_get_collision_flag(EQ_SERIAL_UART_NUM, &collision);
+
+    return collision;
+}
+
+
+/*  ***********************************************
+     ---   ---   ---   ---   ---   ---   ---   ---
+    Framed serial channel
+     ---   ---   ---   ---   ---   ---   ---   ---
+    ***********************************************   */
+static EQSP32* chEQ = nullptr;
+static SerialFraming chFraming = SERIAL_FRAME_COBS;
+static bool chCrc = true;
+static bool chRS485 = false;
+static int chBaud = 115200;
+static SerialFrameCallback chCallback = nullptr;
+static std::atomic<bool> chRunning(false);
+static std::atomic<bool> chRxBusy(false);       // Set while the UART event task is in the receive callback
+
+static uint8_t* chRxBuffer = nullptr;       // Raw (COBS) or decoded (SLIP, length, idle) frame being received
+static size_t chRxCapacity = 0;
+static size_t chRxLength = 0;
+static size_t chRxExpected = 0;             // Length framing, 0 while the header is incomplete
+static bool chRxEscape = false;
+static bool chRxOverflow = false;
+
+static uint8_t* chTxBuffer = nullptr;
+static size_t chTxCapacity = 0;
+static size_t chMaxFrame = 0;
+static SemaphoreHandle_t chTxMutex = NULL;
+
+static SerialChannelStats chStats;
+static portMUX_TYPE chStatsMux = portMUX_INITIALIZER_UNLOCKED;
+
+// CRC-16/CCITT-FALSE
+static uint16_t serialCrc16(const uint8_t* data, size_t length)
+{
+    uint16_t crc = 0xFFFF;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+
+    return crc;
+}
+
+static void serialCountStat(uint32_t SerialChannelStats::*counter)
+{
+    portENTER_CRITICAL(&chStatsMux);
+    chStats.*counter += 1;
+    portEXIT_CRITICAL(&chStatsMux);
+}
+
+static void serialDeliverFrame(uint8_t* frame, size_t length)
+{
+    if (chCrc)
+    {
+        if (length < 2 || serialCrc16(frame, length - 2) != ((frame[length - 2] << 8) | frame[length - 1]))
+        {
+            serialCountStat(&SerialChannelStats::crcErrors);
+            return;
+        }
+        length -= 2;
+    }
+
+    serialCountStat(&SerialChannelStats::framesReceived);
+    chCallback(frame, length);
+}
+
+// Decodes a COBS frame in place, returns false if it is malformed
+static bool serialCobsDecode(uint8_t* data, size_t length, size_t& decoded)
+{
+    size_t in = 0;
+    size_t out = 0;
+
+    while (in < length)
+    {
+        uint8_t code = data[in++];
+        if (code == 0 || in + code - 1 > length)
+            return false;
+        for (int i = 1; i < code; i++)
+            data[out++] = data[in++];
+        if (code < 0xFF && in < length)
+            data[out++] = 0;
+    }
+
+    decoded = out;
+    return true;
+}
+
+static void serialEndFrame()
+{
+    if (chRxOverflow)
+        serialCountStat(&SerialChannelStats::overflows);
+    else if (chRxLength > 0)
+    {
+        size_t length = chRxLength;
+        if (chFraming != SERIAL_FRAME_COBS || serialCobsDecode(chRxBuffer, chRxLength, length))
+            serialDeliverFrame(chRxBuffer, length);
+        else
+            serialCountStat(&SerialChannelStats::framingErrors);
+    }
+
+    chRxLength = 0;
+    chRxExpected = 0;
+    chRxEscape = false;
+    chRxOverflow = false;
+}
+
+static void serialStoreByte(uint8_t b)
+{
+    if (chRxLength < chRxCapacity)
+        chRxBuffer[chRxLength++] = b;
+    else
+        chRxOverflow = true;
+}
+
+static void serialDecode(const uint8_t* data, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        uint8_t b = data[i];
+        switch (chFraming)
+        {
+            case SERIAL_FRAME_COBS:
+                if (b == 0)
+                    serialEndFrame();
+                else
+                    serialStoreByte(b);
+                break;
+
+            case SERIAL_FRAME_SLIP:
+                if (b == SLIP_END)
+                    serialEndFrame();
+                else if (chRxEscape)
+                {
+                    chRxEscape = false;
+                    serialStoreByte(b == SLIP_ESC_END ? SLIP_END : b == SLIP_ESC_ESC ? SLIP_ESC : b);
+                }
+                else if (b == SLIP_ESC)
+                    chRxEscape = true;
+                else
+                    serialStoreByte(b);
+                break;
+
+            case SERIAL_FRAME_LENGTH:
+                serialStoreByte(b);
+                if (chRxExpected == 0 && chRxLength == 2)
+                {
+                    chRxExpected = (chRxBuffer[0] << 8) | chRxBuffer[1];
+                    chRxLength = 0;
+                    if (chRxExpected == 0 || chRxExpected > chMaxFrame)
+                    {
+                        // Not a header, resynchronise on the next byte
+                        serialCountStat(&SerialChannelStats::framingErrors);
+                        chRxBuffer[0] = chRxBuffer[1];
+                        chRxLength = 1;
+                        chRxExpected = 0;
+                    }
+                }
+                else if (chRxExpected != 0 && chRxLength == chRxExpected)
+                    serialEndFrame();
+                break;
+
+            case SERIAL_FRAME_IDLE:
+                serialStoreByte(b);
+                break;
+        }
+    }
+}
+
+// Runs in the UART event task
+static void serialChannelOnReceive()
+{
+    chRxBusy.store(true);
+    if (!chRunning.load())
+    {
+        chRxBusy.store(false);
+        return;
+    }
+
+    HardwareSerial& port = chEQ->Serial;
+    uint8_t chunk[SERIAL_CHANNEL_CHUNK];
+
+    int available;
+    while ((available = port.available()) > 0)
+    {
+        size_t n = port.read(chunk, (size_t)available < sizeof(chunk) ? available : sizeof(chunk));
+        serialDecode(chunk, n);
+    }
+
+    if (chFraming == SERIAL_FRAME_IDLE)
+        serialEndFrame();       // Called on RX timeout only, the line went idle
+
+    chRxBusy.store(false);
+}
+
+static size_t serialEncode(const uint8_t* data, size_t length, uint16_t crc)
+{
+    uint8_t trailer[2] = {(uint8_t)(crc >> 8), (uint8_t)crc};
+    size_t total = length + (chCrc ? 2 : 0);
+    uint8_t* out = chTxBuffer;
+    size_t n = 0;
+
+    auto byteAt = [&](size_t i) { return i < length ? data[i] : trailer[i - length]; };
+
+    switch (chFraming)
+    {
+        case SERIAL_FRAME_COBS:
+        {
+            size_t code = n++;
+            uint8_t run = 1;
+            for (size_t i = 0; i < total; i++)
+            {
+                uint8_t b = byteAt(i);
+                if (b != 0)
+                {
+                    out[n++] = b;
+                    run++;
+                }
+                if (b == 0 || run == 0xFF)
+                {
+                    out[code] = run;
+                    code = n++;
+                    run = 1;
+                }
+            }
+            out[code] = run;
+            out[n++] = 0;
+            break;
+        }
+
+        case SERIAL_FRAME_SLIP:
+            out[n++] = SLIP_END;        // Flushes any line noise received before the frame
+            for (size_t i = 0; i < total; i++)
+            {
+                uint8_t b = byteAt(i);
+                if (b == SLIP_END || b == SLIP_ESC)
+                {
+                    out[n++] = SLIP_ESC;
+                    out[n++] = b == SLIP_END ? SLIP_ESC_END : SLIP_ESC_ESC;
+                }
+                else
+                    out[n++] = b;
+            }
+            out[n++] = SLIP_END;
+            break;
+
+        case SERIAL_FRAME_LENGTH:
+            out[n++] = total >> 8;
+            out[n++] = total & 0xFF;
+            // fall through
+        case SERIAL_FRAME_IDLE:
+            for (size_t i = 0; i < total; i++)
+                out[n++] = byteAt(i);
+            break;
+    }
+
+    return n;
+}
+
+static void serialChannelFree()
+{
+    memoryFree(chRxBuffer);
+    memoryFree(chTxBuffer);
+    chRxBuffer = nullptr;
+    chTxBuffer = nullptr;
+}
+
+bool EQSP32::startSerialChannel(EQSerialMode mode, int baud, SerialFraming framing, SerialFrameCallback callback,
+                                bool crc, size_t maxFrame)
+{
+    if (callback == nullptr || maxFrame == 0 || maxFrame > 0xFFFF - 2 || baud <= 0)
+        return false;
+    if (chRunning.load(std::memory_order_acquire))
+        stopSerialChannel();
+
+    if (chTxMutex == NULL)
+        chTxMutex = xSemaphoreCreateMutex();
+    if (chTxMutex == NULL || !serialClaimPort())
+        return false;
+
+    // Frame payload and CRC, plus the worst case COBS/SLIP/length overhead on transmit
+    chMaxFrame = maxFrame + (crc ? 2 : 0);
+    chRxCapacity = chMaxFrame + chMaxFrame / 254 + 1;
+    chTxCapacity = 2 * chMaxFrame + 2;
+    chRxBuffer = (uint8_t*)memoryAlloc(MEMORY_SERIAL, chRxCapacity);
+    chTxBuffer = (uint8_t*)memoryAlloc(MEMORY_SERIAL, chTxCapacity);
+    if (chRxBuffer == nullptr || chTxBuffer == nullptr)
+    {
+        serialChannelFree();
+        serialReleasePort();
+        return false;
+    }
+
+    chRS485 = mode == RS485_TX || mode == RS485_RX;
+    if (!configSerial(chRS485 ? RS485_RX : mode, baud))
+    {
+        serialChannelFree();
+        serialReleasePort();
+        return false;
+    }
+
+    // The driver buffers can only be resized while the port is stopped
+    Serial.end();
+    Serial.setRxBufferSize(SERIAL_CHANNEL_RX_BUFFER);
+    Serial.setTxBufferSize(SERIAL_CHANNEL_TX_BUFFER);
+    Serial.begin(baud, SERIAL_8N1, getPin(chRS485 ? EQ_RS485_RX : EQ_RS232_RX), getPin(chRS485 ? EQ_RS485_TX : EQ_RS232_TX), mode == RS232_INV);
+    if (chRS485 && serialRS485Auto())
+        serialEnableRS485Auto(this, rs485AutoInvert);
+
+    chEQ = this;
+    chFraming = framing;
+    chCrc = crc;
+    chBaud = baud;
+    chCallback = callback;
+    chRxLength = 0;
+    chRxExpected = 0;
+    chRxEscape = false;
+    chRxOverflow = false;
+    portENTER_CRITICAL(&chStatsMux);
+    chStats = SerialChannelStats();
+    portEXIT_CRITICAL(&chStatsMux);
+    chRunning.store(true, std::memory_order_release);
+
+    if (framing == SERIAL_FRAME_IDLE)
+        Serial.setRxTimeout(SERIAL_CHANNEL_RX_TIMEOUT);
+    Serial.onReceive(serialChannelOnReceive, framing == SERIAL_FRAME_IDLE);
+    return true;
+}
+
+void EQSP32::stopSerialChannel()
+{
+    if (!chRunning.exchange(false))
+        return;
+
+    Serial.onReceive(NULL);
+    while (chRxBusy.load())
+        vTaskDelay(pdMS_TO_TICKS(1));
+
+    xSemaphoreTake(chTxMutex, portMAX_DELAY);
+    serialChannelFree();
+    xSemaphoreGive(chTxMutex);
+    serialReleasePort();
+}
+
+bool EQSP32::sendSerialFrame(const uint8_t* data, size_t length)
+{
+    if (!chRunning.load(std::memory_order_acquire) || length + (chCrc ? 2 : 0) > chMaxFrame || (data == nullptr && length > 0))
+        return false;
+
+    xSemaphoreTake(chTxMutex, portMAX_DELAY);
+    if (chTxBuffer == nullptr)
+    {
+        xSemaphoreGive(chTxMutex);
+        return false;
+    }
+
+    size_t n = serialEncode(data, length, chCrc ? serialCrc16(data, length) : 0);
+    bool switchDirection = chRS485 && !serialRS485Auto();
+    if (switchDirection)
+        configSerial(RS485_TX, chBaud);
+    size_t written = Serial.write(chTxBuffer, n);
+    if (switchDirection)
+    {
+        Serial.flush();
+        configSerial(RS485_RX, chBaud);
+    }
+    xSemaphoreGive(chTxMutex);
+
+    serialCountStat(written == n ? &SerialChannelStats::framesSent : &SerialChannelStats::overflows);
+    return written == n;
+}
+
+SerialChannelStats EQSP32::getSerialChannelStats()
+{
+    portENTER_CRITICAL(&chStatsMux);
+    SerialChannelStats stats = chStats;
+    portEXIT_CRITICAL(&chStatsMux);
+
+    return stats;
+}
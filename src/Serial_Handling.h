@@ -0,0 +1,16 @@
+#ifndef Serial_Handling_h
+#define Serial_Handling_h
+
+#include "EQSP32.h"
+
+#define EQ_SERIAL_UART_NUM      UART_NUM_2      // EQSP32::Serial is Serial2
+
+// True while configRS485Auto() has handed the RS485 enable pin to the UART, until disableRS485Auto()
+bool serialRS485Auto();
+bool serialRS485AutoInvert();
+
+// EQSP32::Serial is used by one protocol layer at a time (Modbus master/slave, framed channel)
+bool serialClaimPort();
+void serialReleasePort();
+
+#endif
@@ -0,0 +1,74 @@
+#include "Task_Handling.h"
+
+
+/*  ***********************************************
+     ---   ---   ---   ---   ---   ---   ---   ---
+    Library task priorities
+     ---   ---   ---   ---   ---   ---   ---   ---
+    ***********************************************   */
+static const char* const taskConfigIO[] = {
+    "EQSP32_SystemManager",
+    "EQSP32_xModuleManager",
+};
+
+static const char* const taskConfigNetwork[] = {
+    "EQSP32_DatabaseHandler",
+    "EQSP32_EQConnectHandler",
+    "EQSP32_MqttDevice",
+};
+
+TaskHandle_t taskFindByName(const char* name)
+{
+    if (name == nullptr || name[0] == '\0')
+        return NULL;
+
+    char stored[configMAX_TASK_NAME_LEN];
+    strncpy(stored, name, sizeof(stored) - 1);
+    stored[sizeof(stored) - 1] = '\0';
+    return xTaskGetHandle(stored);
+}
+
+bool EQSP32::configTaskPriority(const std::string& task, int priority)
+{
+    if (priority < 1 || priority >= configMAX_PRIORITIES)
+        return false;
+
+    TaskHandle_t handle = taskFindByName(task.c_str());
+    if (handle == NULL)
+        return false;
+
+    vTaskPrioritySet(handle, priority);
+    return true;
+}
+
+int EQSP32::readTaskPriority(const std::string& task)
+{
+    TaskHandle_t handle = taskFindByName(task.c_str());
+    return handle != NULL ? (int)uxTaskPriorityGet(handle) : -1;
+}
+
+bool EQSP32::configRealtimeIO()
+{
+    int networkPriority = 0;
+    for (const char* name : taskConfigNetwork)
+    {
+        int priority = readTaskPriority(name);
+        if (priority > networkPriority)
+            networkPriority = priority;
+    }
+
+    bool ok = false;
+    for (const char* name : taskConfigIO)
+    {
+        int priority = readTaskPriority(name);
+        if (priority < 0)
+            continue;           // Not running, e.g. no expansion modules
+        ok = true;
+        if (priority > networkPriority)
+            continue;
+
+        if (!configTaskPriority(name, networkPriority + 1))
+            return false;
+    }
+    return ok;
+}
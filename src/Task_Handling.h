@@ -0,0 +1,14 @@
+#ifndef Task_Handling_h
+#define Task_Handling_h
+
+#include "EQSP32.h"
+
+// xTaskGetHandle() asserts on names of configMAX_TASK_NAME_LEN characters or more, and FreeRTOS keeps only the first
+// configMAX_TASK_NAME_LEN - 1. Library task names are looked up on that prefix, NULL if the task is not running.
+TaskHandle_t taskFindByName(const char* name);
+
+// Protocol services (CANopen, J1939, Modbus) run above loop() and below the lwIP thread (ESP_TASK_TCPIP_PRIO), so a busy
+// bus cannot starve the network. Set at task start, adjustable afterwards with configTaskPriority().
+#define TASK_PRIORITY_PROTOCOL  4
+
+#endif
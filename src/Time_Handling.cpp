@@ -0,0 +1,65 @@
+#include "EQSP32.h"
+
+#include <atomic>
+
+
+/*  ***********************************************
+     ---   ---   ---   ---   ---   ---   ---   ---
+    Cached local time
+     ---   ---   ---   ---   ---   ---   ---   ---
+    ***********************************************   */
+// Double buffered: the first caller of a new second fills the buffer readers are not using, then bumps the sequence.
+// Readers retry if the sequence moved while they were copying.
+static EQTime localTimeCache[2];
+static std::atomic<uint32_t> localTimeSeq(0);
+static std::atomic<bool> localTimeUpdating(false);
+
+static void localTimeUpdate(EQSP32* eq, time_t now)
+{
+    // One updater at a time, others keep using the previous second
+    if (localTimeUpdating.exchange(true, std::memory_order_acquire))
+        return;
+
+    uint32_t seq = localTimeSeq.load(std::memory_order_relaxed);
+    if (localTimeCache[seq & 1].unixTime != now)
+    {
+        struct tm timeinfo;
+        localtime_r(&now, &timeinfo);       // Applies the TZ rules, including DST transitions
+
+        EQTime& time = localTimeCache[(seq + 1) & 1];
+        time.year = timeinfo.tm_year + 1900;
+        time.month = timeinfo.tm_mon + 1;
+        time.day = timeinfo.tm_mday;
+        time.hour = timeinfo.tm_hour;
+        time.mins = timeinfo.tm_min;
+        time.secs = timeinfo.tm_sec;
+        time.weekDay = timeinfo.tm_wday;
+        time.yearDay = timeinfo.tm_yday;
+        time.isDst = timeinfo.tm_isdst > 0;
+        time.synced = eq->isLocalTimeSynced();
+        time.unixTime = now;
+
+        localTimeSeq.store(seq + 1, std::memory_order_release);
+    }
+
+    localTimeUpdating.store(false, std::memory_order_release);
+}
+
+bool EQSP32::getLocalTime(EQTime& time)
+{
+    time_t now = ::time(nullptr);
+    uint32_t seq;
+    do
+    {
+        seq = localTimeSeq.load(std::memory_order_acquire);
+        if (localTimeCache[seq & 1].unixTime != now)
+        {
+            localTimeUpdate(this, now);
+            seq = localTimeSeq.load(std::memory_order_acquire);
+        }
+        time = localTimeCache[seq & 1];
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while (localTimeSeq.load(std::memory_order_relaxed) != seq);
+
+    return time.synced;
+}
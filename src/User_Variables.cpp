@@ -0,0 +1,233 @@
+#include "Sampling_Handling.h"
+
+#include <atomic>
+
+#define USER_BOOL_SUB_MAX           16      // Max concurrent user bool subscriptions
+#define USER_BOOL_SUB_PERIOD_MS     10      // Subscription sampling period
+#define USER_BOOL_SUB_STACK         2048
+#define USER_BOOL_SUB_PRIORITY      2
+
+typedef struct {
+    std::atomic<int> idx;               // Watched user bool index, 0 marks a free slot
+    TrigMode trigMode;
+    bool fresh;                         // Seed prevValue on the next sample instead of detecting an edge
+    bool prevValue;
+    std::atomic<bool> value;            // Last sampled value
+    std::atomic<uint32_t> edges;        // Latched edges not yet consumed
+} UserBoolSubscription;
+
+static UserBoolSubscription userBoolSubs[USER_BOOL_SUB_MAX];
+static portMUX_TYPE userBoolSubsMux = portMUX_INITIALIZER_UNLOCKED;
+static std::atomic<bool> userBoolSubsTaskStarted(false);
+
+
+/*  ***********************************************
+     ---   ---   ---   ---   ---   ---   ---   ---
+    User variables bulk access
+     ---   ---   ---   ---   ---   ---   ---   ---
+    ***********************************************   */
+int EQSP32::readUserBools(int start, int count, bool* out)
+{
+    if (out == nullptr || start < 1 || start > USER_NUM_BOOL || count <= 0)
+        return 0;
+    if (count > USER_NUM_BOOL - start + 1)
+        count = USER_NUM_BOOL - start + 1;
+
+    // Sampled from the database, readUserBool() would reset the edge state of its trigger modes
+    for (int i = 0; i < count; i++)
+        out[i] = userBoolSample(start + i);
+
+    return count;
+}
+
+int EQSP32::readUserInts(int start, int count, int* out)
+{
+    if (out == nullptr || start < 1 || start > USER_NUM_INT || count <= 0)
+        return 0;
+    if (count > USER_NUM_INT - start + 1)
+        count = USER_NUM_INT - start + 1;
+
+    for (int i = 0; i < count; i++)
+        out[i] = userIntSample(start + i);
+
+    return count;
+}
+
+int EQSP32::writeUserBools(int start, const bool* values, int n)
+{
+    if (values == nullptr || start < 1 || n <= 0)
+        return 0;
+    if (n > USER_NUM_BOOL - start + 1)
+        n = USER_NUM_BOOL - start + 1;          // writeUserBool ignores indexes out of range
+
+    int changed = 0;
+    for (int i = 0; i < n; i++)
+    {
+        // Skip unchanged entries so that they do not produce database updates
+        if (userBoolSample(start + i) == values[i])
+            continue;
+        writeUserBool(start + i, values[i]);
+        changed++;
+    }
+
+    return changed;
+}
+
+int EQSP32::writeUserInts(int start, const int* values, int n)
+{
+    if (values == nullptr || start < 1 || n <= 0)
+        return 0;
+    if (n > USER_NUM_INT - start + 1)
+        n = USER_NUM_INT - start + 1;
+
+    int changed = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (userIntSample(start + i) == values[i])
+            continue;
+        writeUserInt(start + i, values[i]);
+        changed++;
+    }
+
+    return changed;
+}
+
+
+/*  ***********************************************
+     ---   ---   ---   ---   ---   ---   ---   ---
+    User bool subscriptions
+     ---   ---   ---   ---   ---   ---   ---   ---
+    ***********************************************   */
+static bool isUserBoolEdge(bool prev, bool current, TrigMode trigMode)
+{
+    switch (trigMode)
+    {
+        case ON_RISING:     return !prev && current;
+        case ON_FALLING:    return prev && !current;
+        case ON_TOGGLE:     return prev != current;
+        default:            return false;
+    }
+}
+
+static void userBoolSubscriptionTask(void* arg)
+{
+    TickType_t lastWake = xTaskGetTickCount();
+
+    for (;;)
+    {
+        int slotIdx[USER_BOOL_SUB_MAX];
+        int slotSample[USER_BOOL_SUB_MAX];
+        int sampledIdx[USER_BOOL_SUB_MAX];
+        bool sampledValue[USER_BOOL_SUB_MAX];
+        int sampledCount = 0;
+
+        for (int i = 0; i < USER_BOOL_SUB_MAX; i++)
+        {
+            slotIdx[i] = userBoolSubs[i].idx.load(std::memory_order_acquire);
+            if (slotIdx[i] == 0)
+                continue;
+
+            // Sample each index once per cycle so all subscribers of an index see the same value. Sampled from the
+            // database, readUserBool() would reset the edge state of the sketch's own trigger mode reads.
+            int s = 0;
+            while (s < sampledCount && sampledIdx[s] != slotIdx[i])
+                s++;
+            if (s == sampledCount)
+            {
+                sampledIdx[s] = slotIdx[i];
+                sampledValue[s] = userBoolSample(slotIdx[i]);
+                sampledCount++;
+            }
+            slotSample[i] = s;
+        }
+
+        // Slots may be reused while sampling, edge state is only updated for the index that was sampled
+        portENTER_CRITICAL(&userBoolSubsMux);
+        for (int i = 0; i < USER_BOOL_SUB_MAX; i++)
+        {
+            UserBoolSubscription& sub = userBoolSubs[i];
+            if (slotIdx[i] == 0 || sub.idx.load(std::memory_order_relaxed) != slotIdx[i])
+                continue;
+
+            bool current = sampledValue[slotSample[i]];
+            if (sub.fresh)
+                sub.fresh = false;
+            else if (isUserBoolEdge(sub.prevValue, current, sub.trigMode))
+                sub.edges.fetch_add(1, std::memory_order_release);
+            sub.prevValue = current;
+            sub.value.store(current, std::memory_order_release);
+        }
+        portEXIT_CRITICAL(&userBoolSubsMux);
+
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(USER_BOOL_SUB_PERIOD_MS));
+    }
+}
+
+int EQSP32::subscribeUserBool(int idx, TrigMode trigMode)
+{
+    if (idx < 1 || idx > USER_NUM_BOOL)
+        return -1;
+
+    bool initialValue = userBoolSample(idx);
+    int token = -1;
+
+    portENTER_CRITICAL(&userBoolSubsMux);
+    for (int i = 0; i < USER_BOOL_SUB_MAX; i++)
+    {
+        UserBoolSubscription& sub = userBoolSubs[i];
+        if (sub.idx.load(std::memory_order_relaxed) != 0)
+            continue;
+        sub.trigMode = trigMode;
+        sub.fresh = true;
+        sub.value.store(initialValue, std::memory_order_relaxed);
+        sub.edges.store(0, std::memory_order_relaxed);
+        sub.idx.store(idx, std::memory_order_release);      // Slot becomes visible to the sampling task
+        token = i;
+        break;
+    }
+    portEXIT_CRITICAL(&userBoolSubsMux);
+
+    if (token >= 0 && !userBoolSubsTaskStarted.exchange(true) &&
+        xTaskCreatePinnedToCore(userBoolSubscriptionTask, "EQSP32_UBoolSub", USER_BOOL_SUB_STACK, NULL,
+                                USER_BOOL_SUB_PRIORITY, NULL, tskNO_AFFINITY) != pdPASS)
+    {
+        userBoolSubsTaskStarted.store(false);       // Retried by the next subscription
+        unsubscribeUserBool(token);
+        token = -1;
+    }
+
+    return token;
+}
+
+bool EQSP32::readUserBoolEvent(int token)
+{
+    if (token < 0 || token >= USER_BOOL_SUB_MAX)
+        return false;
+
+    UserBoolSubscription& sub = userBoolSubs[token];
+    if (sub.idx.load(std::memory_order_acquire) == 0)
+        return false;
+
+    if (sub.trigMode == STATE)
+        return sub.value.load(std::memory_order_acquire);
+
+    // Consume a single edge, lock-free against the sampling task
+    uint32_t edges = sub.edges.load(std::memory_order_acquire);
+    while (edges > 0)
+    {
+        if (sub.edges.compare_exchange_weak(edges, edges - 1, std::memory_order_acq_rel))
+            return true;
+    }
+    return false;
+}
+
+void EQSP32::unsubscribeUserBool(int token)
+{
+    if (token < 0 || token >= USER_BOOL_SUB_MAX)
+        return;
+
+    portENTER_CRITICAL(&userBoolSubsMux);
+    userBoolSubs[token].idx.store(0, std::memory_order_release);
+    userBoolSubs[token].edges.store(0, std::memory_order_relaxed);
+    portEXIT_CRITICAL(&userBoolSubsMux);
+}